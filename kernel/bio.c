@@ -10,6 +10,8 @@
 // * After changing buffer data, call bwrite to write it to disk.
 // * When done with the buffer, call brelse.
 // * Do not use the buffer after calling brelse.
+// * breadv and bwritev do the same for several buffers at once,
+//     letting the disk work on them together.
 // * Only one process at a time can use a buffer,
 //     so do not keep them longer than necessary.
 
@@ -22,6 +24,7 @@
 #include "defs.h"
 #include "fs.h"
 #include "buf.h"
+#include "trace.h"
 
 struct {
   struct spinlock lock;
@@ -65,6 +68,7 @@ bget(uint dev, uint blockno)
   for(b = bcache.head.next; b != &bcache.head; b = b->next){
     if(b->dev == dev && b->blockno == blockno){
       b->refcnt++;
+      trace(TR_BHIT, dev, blockno, 0);
       release(&bcache.lock);
       acquiresleep(&b->lock);
       return b;
@@ -74,6 +78,9 @@ bget(uint dev, uint blockno)
   // Not cached; recycle an unused buffer.
   for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
     if(b->refcnt == 0) {
+      trace(TR_BMISS, dev, blockno, 0);
+      if(b->valid)
+        trace(TR_BEVICT, b->dev, b->blockno, 0);
       b->dev = dev;
       b->blockno = blockno;
       b->valid = 0;
@@ -109,6 +116,53 @@ bwrite(struct buf *b)
   virtio_disk_rw(b->dev, b, 1);
 }
 
+// Return locked bufs with the contents of the n distinct
+// blocks blocknos[0..n-1] of dev in bufs[0..n-1], reading
+// those not in the cache all together.  n is at most
+// MAXOPBLOCKS.
+void
+breadv(uint dev, uint *blocknos, int n, struct buf **bufs)
+{
+  struct buf *miss[MAXOPBLOCKS];
+  int i, nmiss;
+
+  if(n > MAXOPBLOCKS)
+    panic("breadv");
+  nmiss = 0;
+  for(i = 0; i < n; i++){
+    bufs[i] = bget(dev, blocknos[i]);
+    if(!bufs[i]->valid)
+      miss[nmiss++] = bufs[i];
+  }
+  virtio_disk_rwv(dev, miss, nmiss, 0);
+  for(i = 0; i < nmiss; i++)
+    miss[i]->valid = 1;
+}
+
+// Return a locked buf for block blockno of dev without reading
+// it, for a caller that will overwrite all of its data.
+struct buf*
+bnew(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bget(dev, blockno);
+  b->valid = 1;
+  return b;
+}
+
+// Write the contents of the n bufs in bufs, all locked and
+// all on the same device, to disk together.
+void
+bwritev(struct buf **bufs, int n)
+{
+  for(int i = 0; i < n; i++)
+    if(!holdingsleep(&bufs[i]->lock) || bufs[i]->dev != bufs[0]->dev)
+      panic("bwritev");
+  if(n > 0)
+    virtio_disk_rwv(bufs[0]->dev, bufs, n, 1);
+}
+
 // Release a locked buffer.
 // Move to the head of the MRU list.
 void
@@ -1,6 +1,7 @@
 struct buf {
   int valid;   // has data been read from disk?
   int disk;    // does disk "own" buf?
+  int logged;  // in the current log transaction? (protected by log lock)
   uint dev;
   uint blockno;
   struct sleeplock lock;
@@ -31,18 +31,11 @@
 void
 consputc(int c)
 {
-  extern volatile int panicked; // from printf.c
-
-  if(panicked){
-    for(;;)
-      ;
-  }
-
   if(c == BACKSPACE){
     // if the user typed backspace, overwrite with a space.
-    uartputc('\b'); uartputc(' '); uartputc('\b');
+    uartputc_sync('\b'); uartputc_sync(' '); uartputc_sync('\b');
   } else {
-    uartputc(c);
+    uartputc_sync(c);
   }
 }
 
@@ -58,23 +51,29 @@ struct {
 } cons;
 
 //
-// user write()s to the console go here.
+// user write()s to the console go here.  they are copied
+// in a chunk at a time to the uart's transmit buffer, and
+// the writer sleeps if it fills up.  cons.lock is not
+// needed; uartwrite() waits for room for a whole chunk
+// before adding any of it, so chunks don't interleave.
 //
 int
 consolewrite(int user_src, uint64 src, int n)
 {
-  int i;
-
-  acquire(&cons.lock);
-  for(i = 0; i < n; i++){
-    char c;
-    if(either_copyin(&c, user_src, src+i, 1) == -1)
+  char buf[128];
+  int i, m, w;
+
+  for(i = 0; i < n; i += w){
+    m = n - i;
+    if(m > sizeof(buf))
+      m = sizeof(buf);
+    if(either_copyin(buf, user_src, src+i, m) == -1)
       break;
-    consputc(c);
+    if((w = uartwrite(buf, m)) < m)
+      return i + w;
   }
-  release(&cons.lock);
 
-  return n;
+  return i;
 }
 
 //
@@ -0,0 +1,180 @@
+// Directory name-lookup cache.
+//
+// The dcache remembers the results of recent dirlookup() calls:
+// the inode number that a name maps to in a directory, or that
+// the name is absent (inum 0, a negative entry).  namex() can
+// then resolve repeatedly used paths without reading through
+// the directories block by block.
+//
+// Entries are keyed by (dev, directory inum, name), hashed into
+// NDHASH chains, and recycled in least-recently-used order.
+// Callers must hold the directory's sleeplock while looking up
+// or changing entries for it, which keeps each entry consistent
+// with the directory's contents on disk:
+// * dirlookup() fills in entries after scanning the directory.
+// * dirlink() and unlink() update the entry for the name they
+//   add or remove.
+// * iput() purges a directory's entries when it frees the
+//   directory's inode, since the inum may be reused.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "fs.h"
+
+#define NDHASH 61
+
+struct dentry {
+  uint dev;
+  uint dir;       // inum of the directory; 0 if the entry is unused
+  char name[DIRSIZ];
+  uint inum;      // 0 means name is not in dir
+  struct dentry *hnext;          // hash chain
+  struct dentry *prev, *next;    // LRU list
+};
+
+struct {
+  struct spinlock lock;
+  struct dentry dentry[NDCACHE];
+  struct dentry *hash[NDHASH];
+
+  // Linked list of all entries, through prev/next.
+  // head.next is most recently used.
+  struct dentry head;
+} dcache;
+
+void
+dcacheinit(void)
+{
+  struct dentry *d;
+
+  initlock(&dcache.lock, "dcache");
+  dcache.head.prev = &dcache.head;
+  dcache.head.next = &dcache.head;
+  for(d = dcache.dentry; d < dcache.dentry+NDCACHE; d++){
+    d->next = dcache.head.next;
+    d->prev = &dcache.head;
+    dcache.head.next->prev = d;
+    dcache.head.next = d;
+  }
+}
+
+static uint
+dhash(uint dev, uint dir, char *name)
+{
+  uint h = dev*31 + dir;
+
+  for(int i = 0; i < DIRSIZ && name[i]; i++)
+    h = h*31 + (uchar)name[i];
+  return h % NDHASH;
+}
+
+// Find the entry for name in dir.
+// Caller must hold dcache.lock.
+static struct dentry*
+dfind(uint dev, uint dir, char *name)
+{
+  struct dentry *d;
+
+  for(d = dcache.hash[dhash(dev, dir, name)]; d; d = d->hnext)
+    if(d->dev == dev && d->dir == dir && namecmp(d->name, name) == 0)
+      return d;
+  return 0;
+}
+
+// Take d off its hash chain and make it unused.
+// Caller must hold dcache.lock.
+static void
+dunhash(struct dentry *d)
+{
+  struct dentry **pp;
+
+  for(pp = &dcache.hash[dhash(d->dev, d->dir, d->name)]; *pp; pp = &(*pp)->hnext){
+    if(*pp == d){
+      *pp = d->hnext;
+      break;
+    }
+  }
+  d->dir = 0;
+}
+
+// Move d to the front (most recently used) or back of the LRU list.
+// Caller must hold dcache.lock.
+static void
+dmove(struct dentry *d, int front)
+{
+  d->next->prev = d->prev;
+  d->prev->next = d->next;
+  if(front){
+    d->next = dcache.head.next;
+    d->prev = &dcache.head;
+  } else {
+    d->next = &dcache.head;
+    d->prev = dcache.head.prev;
+  }
+  d->next->prev = d;
+  d->prev->next = d;
+}
+
+// Look up name in directory dir.
+// Returns 1 and sets *inum (0 if the name is known to be
+// absent) if the answer is cached, otherwise returns 0.
+int
+dcachelookup(uint dev, uint dir, char *name, uint *inum)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  if((d = dfind(dev, dir, name)) == 0){
+    release(&dcache.lock);
+    return 0;
+  }
+  *inum = d->inum;
+  dmove(d, 1);
+  release(&dcache.lock);
+  return 1;
+}
+
+// Record that name in directory dir refers to inum,
+// or is absent if inum is 0.
+void
+dcacheenter(uint dev, uint dir, char *name, uint inum)
+{
+  struct dentry *d;
+  uint h;
+
+  acquire(&dcache.lock);
+  if((d = dfind(dev, dir, name)) == 0){
+    // Recycle the least recently used entry.
+    d = dcache.head.prev;
+    if(d->dir)
+      dunhash(d);
+    d->dev = dev;
+    d->dir = dir;
+    strncpy(d->name, name, DIRSIZ);
+    h = dhash(dev, dir, name);
+    d->hnext = dcache.hash[h];
+    dcache.hash[h] = d;
+  }
+  d->inum = inum;
+  dmove(d, 1);
+  release(&dcache.lock);
+}
+
+// Forget all entries for directory dir.
+void
+dcachepurge(uint dev, uint dir)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  for(d = dcache.dentry; d < dcache.dentry+NDCACHE; d++){
+    if(d->dir == dir && d->dev == dev){
+      dunhash(d);
+      dmove(d, 0);
+    }
+  }
+  release(&dcache.lock);
+}
@@ -1,9 +1,11 @@
 struct buf;
 struct context;
+struct evdev;
 struct file;
 struct inode;
 struct pipe;
 struct proc;
+struct shmseg;
 struct spinlock;
 struct sleeplock;
 struct stat;
@@ -14,6 +16,9 @@ void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+void            breadv(uint, uint*, int, struct buf**);
+struct buf*     bnew(uint, uint);
+void            bwritev(struct buf**, int);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
 
@@ -22,6 +27,12 @@ void            consoleinit(void);
 void            consoleintr(int);
 void            consputc(int);
 
+// dcache.c
+void            dcacheinit(void);
+int             dcachelookup(uint, uint, char*, uint*);
+void            dcacheenter(uint, uint, char*, uint);
+void            dcachepurge(uint, uint);
+
 // exec.c
 int             exec(char*, char**);
 
@@ -33,19 +44,28 @@ void            fileinit(void);
 int             fileread(struct file*, uint64, int n);
 int             filestat(struct file*, uint64 addr);
 int             filewrite(struct file*, uint64, int n);
+int             filepread(struct file*, uint64, int n, uint);
+int             filepwrite(struct file*, uint64, int n, uint);
+int             filesync(struct file*);
+int             filetruncate(struct file*, uint);
+int             filesendfile(struct file*, struct file*, int, int);
+int             filesplice(struct file*, struct file*, int);
 
 // fs.c
+int             bcommit(int);
 void            fsinit(int);
 int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
+int             isdirempty(struct inode*);
 void            iinit();
 void            ilock(struct inode*);
 void            iput(struct inode*);
 void            iunlock(struct inode*);
 void            iunlockput(struct inode*);
 void            iupdate(struct inode*);
+void            itruncate(struct inode*, uint);
 int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
@@ -67,24 +87,35 @@ void            kinit();
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
 void            begin_op(int);
+void            begin_opn(int, int);
 void            end_op(int);
+void            end_opn(int, int);
+int             log_ordered(int);
+int             log_max(int);
+void            log_force(int);
 void            crash_op(int,int);
 
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
-int             piperead(struct pipe*, uint64, int);
-int             pipewrite(struct pipe*, uint64, int);
+int             piperead(struct pipe*, int, uint64, int);
+int             pipewrite(struct pipe*, int, uint64, int);
+int             pipeputpage(struct pipe*, char*, int);
 
 // printf.c
 void            printf(char*, ...);
 void            panic(char*) __attribute__((noreturn));
 void            printfinit(void);
+int             klogconsole(char*, int);
+int             klogread(uint64, int);
 
 // proc.c
 int             cpuid(void);
 void            exit(int);
 int             fork(void);
+int             clone(uint64, uint64, uint64);
+int             join(uint64);
+int             vmshared(struct proc*);
 int             growproc(int);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
@@ -104,6 +135,35 @@ void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
+int             procsysstat(int, uint64, int);
+extern struct spinlock vm_lock;
+
+// futex.c
+void            futexinit(void);
+int             futex_wait(uint64, int);
+int             futex_wake(uint64, int);
+
+// evdev.c
+void            evinit(struct evdev*, char*, void*, int, int, void (*)(void*, int, uint));
+void*           evput(struct evdev*);
+void            evputdone(struct evdev*);
+int             evread(struct evdev*, int, uint64, int);
+int             evwrite(struct evdev*, int, uint64, int);
+
+// trace.c
+void            traceinit(void);
+void            trace(int, uint64, uint64, uint64);
+
+// prof.c
+void            profinit(void);
+void            profintr(void);
+
+// shm.c
+void            shminit(void);
+uint64          shmat(int, int);
+int             shmdt(uint64);
+void            shmdetachall(struct proc*);
+int             shmfork(struct proc*, struct proc*);
 
 // swtch.S
 void            swtch(struct context*, struct context*);
@@ -146,16 +206,27 @@ void            trapinit(void);
 void            trapinithart(void);
 extern struct spinlock tickslock;
 void            usertrapret(void);
+void            ticksync(void);
+void            tickwait(uint);
+void            timeridle(void);
+void            timerbusy(void);
+void            timerpoke(void);
 
 // uart.c
 void            uartinit(void);
 void            uartintr(void);
-void            uartputc(int);
+void            uartputc_sync(int);
+void            uartkick(void);
+int             uartwrite(char*, int);
 int             uartgetc(void);
 
 // vm.c
 void            kvminit(void);
 void            kvminithart(void);
+pagetable_t     kvmcreate(void);
+void            kvmfree(pagetable_t);
+int             kvmmirror(pagetable_t, pagetable_t, uint64, uint64);
+void            kvmunmirror(pagetable_t, uint64, uint64);
 uint64          kvmpa(uint64);
 void            kvmmap(uint64, uint64, uint64, int);
 int             mappages(pagetable_t, uint64, uint64, uint64, int);
@@ -167,6 +238,7 @@ int             uvmcopy(pagetable_t, pagetable_t, uint64);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
+uint64          uvmswap(pagetable_t, pagetable_t, uint64, uint64);
 uint64          walkaddr(pagetable_t, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
@@ -182,6 +254,7 @@ void            plic_complete(int);
 // virtio_disk.c
 void            virtio_disk_init(int);
 void            virtio_disk_rw(int, struct buf *, int);
+void            virtio_disk_rwv(int, struct buf **, int, int);
 void            virtio_disk_intr(int);
 
 // number of elements in fixed-size array
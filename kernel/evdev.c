@@ -0,0 +1,155 @@
+//
+// Event devices: per-CPU rings of records behind a device file,
+// for the profiler (prof.c) and tracing (trace.c).
+//
+// While the device is on, code running with interrupts off
+// calls evput() for a free record in the current CPU's ring,
+// fills it in, and calls evputdone().  Only that CPU writes the
+// ring, so this takes no lock and never waits; if the ring is
+// full, the record is counted as lost.  Nothing wakes up
+// readers either, since records may be logged from inside
+// wakeup() and the scheduler; readers poll once a tick.
+//
+// Writing '1' to the device empties the rings and turns it on,
+// '0' turns it off.  A read hands out whole records, each CPU's
+// in the order they were logged, preceded by a record from the
+// device's lost() for any that were dropped.  It waits until
+// some ring is half full or the device is off, and returns 0
+// once the device is off and every ring is empty.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "evdev.h"
+#include "defs.h"
+
+// Set up d to hand out records of size bytes from buf, which
+// holds a ring of nrec of them for each of NCPU CPUs.
+void
+evinit(struct evdev *d, char *name, void *buf, int size, int nrec,
+       void (*lost)(void*, int, uint))
+{
+  initlock(&d->lock, name);
+  d->buf = buf;
+  d->size = size;
+  d->nrec = nrec;
+  d->lost = lost;
+}
+
+// Return the next free record in this CPU's ring, or 0 if d is
+// off or the ring is full.  Interrupts must be off until the
+// matching evputdone().
+void*
+evput(struct evdev *d)
+{
+  struct evring *r;
+  int id;
+
+  if(!d->on)
+    return 0;
+  id = cpuid();
+  r = &d->ring[id];
+  if(r->w - r->r == d->nrec){
+    __sync_fetch_and_add(&r->lost, 1);
+    return 0;
+  }
+  return d->buf + (id * d->nrec + r->w % d->nrec) * d->size;
+}
+
+// Hand the record from evput() to readers.
+void
+evputdone(struct evdev *d)
+{
+  __sync_synchronize();
+  d->ring[cpuid()].w++;
+}
+
+// Is there a ring worth reading?
+static int
+evready(struct evdev *d)
+{
+  struct evring *r;
+
+  for(r = d->ring; r < &d->ring[NCPU]; r++)
+    if(r->w - r->r >= d->nrec/2 || r->lost)
+      return 1;
+  return 0;
+}
+
+// Copy as many whole records as fit in n bytes to dst.  Each
+// record goes through rec, so that d->lock isn't held across
+// copyout(), which may sleep.
+int
+evread(struct evdev *d, int user_dst, uint64 dst, int n)
+{
+  struct evring *r;
+  char rec[256];
+  int tot, id;
+
+  if(d->size > sizeof(rec))
+    panic("evread");
+
+  acquire(&tickslock);
+  while(d->on && !evready(d)){
+    if(myproc()->killed){
+      release(&tickslock);
+      return -1;
+    }
+    tickwait(ticks + 1);
+  }
+  release(&tickslock);
+
+  tot = 0;
+  for(id = 0; id < NCPU; id++){
+    r = &d->ring[id];
+    while(n - tot >= d->size){
+      acquire(&d->lock);
+      if(r->lost){
+        memset(rec, 0, d->size);
+        d->lost(rec, id, __sync_lock_test_and_set(&r->lost, 0));
+      } else if(r->r != r->w){
+        memmove(rec, d->buf + (id * d->nrec + r->r % d->nrec) * d->size,
+                d->size);
+        __sync_synchronize();
+        r->r++;
+      } else {
+        release(&d->lock);
+        break;
+      }
+      release(&d->lock);
+      if(either_copyout(user_dst, dst + tot, rec, d->size) < 0)
+        return tot;
+      tot += d->size;
+    }
+  }
+  return tot;
+}
+
+// '1' turns d on afresh, '0' turns it off.
+int
+evwrite(struct evdev *d, int user_src, uint64 src, int n)
+{
+  struct evring *r;
+  char c;
+
+  if(n < 1 || either_copyin(&c, user_src, src, 1) < 0)
+    return -1;
+
+  acquire(&d->lock);
+  if(c == '1' && !d->on){
+    for(r = d->ring; r < &d->ring[NCPU]; r++){
+      r->r = r->w;
+      r->lost = 0;
+    }
+    __sync_synchronize();
+    d->on = 1;
+  } else if(c == '0'){
+    d->on = 0;
+  }
+  release(&d->lock);
+  return n;
+}
@@ -0,0 +1,19 @@
+// A device that hands out fixed-size records, which each CPU
+// logs into a ring of its own; see evdev.c.
+
+struct evring {
+  uint r;       // next record to read
+  uint w;       // next record to write
+  uint lost;    // records dropped because the ring was full
+};
+
+struct evdev {
+  struct spinlock lock;  // serializes readers and on/off
+  int on;
+  char *buf;             // each CPU's ring of nrec records in turn
+  int size;              // bytes in a record
+  int nrec;              // records in each CPU's ring
+  struct evring ring[NCPU];
+  // fill in rec as a record saying that n of cpu's were lost.
+  void (*lost)(void *rec, int cpu, uint n);
+};
@@ -21,6 +21,11 @@ exec(char *path, char **argv)
   pagetable_t pagetable = 0, oldpagetable;
   struct proc *p = myproc();
 
+  // exec would free the memory of the other threads
+  // sharing this address space.
+  if(vmshared(p))
+    return -1;
+
   begin_op(ROOTDEV);
 
   if((ip = namei(path)) == 0){
@@ -49,6 +54,8 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr + ph.memsz < ph.vaddr)
       goto bad;
+    if(ph.vaddr + ph.memsz >= SHMBASE)
+      goto bad;
     if((sz = uvmalloc(pagetable, sz, ph.vaddr + ph.memsz)) == 0)
       goto bad;
     if(ph.vaddr % PGSIZE != 0)
@@ -66,6 +73,8 @@ exec(char *path, char **argv)
   // Allocate two pages at the next page boundary.
   // Use the second as the user stack.
   sz = PGROUNDUP(sz);
+  if(sz + 2*PGSIZE >= SHMBASE)
+    goto bad;
   if((sz = uvmalloc(pagetable, sz, sz + 2*PGSIZE)) == 0)
     goto bad;
   uvmclear(pagetable, sz-2*PGSIZE);
@@ -105,10 +114,24 @@ exec(char *path, char **argv)
       last = s+1;
   safestrcpy(p->name, last, sizeof(p->name));
     
+  // Replace the mirror of the old image in the kernel page
+  // table.  The page-table pages covering the old image are
+  // kept, so restoring the old mirror on failure can't fail.
+  kvmunmirror(p->kpagetable, oldsz, 0);
+  if(kvmmirror(pagetable, p->kpagetable, 0, sz) < 0){
+    kvmunmirror(p->kpagetable, sz, 0);
+    kvmmirror(p->pagetable, p->kpagetable, 0, oldsz);
+    goto bad;
+  }
+
+  // Shared-memory segments are not inherited across exec.
+  shmdetachall(p);
+
   // Commit to the user image.
   oldpagetable = p->pagetable;
   p->pagetable = pagetable;
   p->sz = sz;
+  p->guard = sz - 2*PGSIZE;
   p->tf->epc = elf.entry;  // initial program counter = main
   p->tf->sp = sp; // initial stack pointer
   proc_freepagetable(oldpagetable, oldsz);
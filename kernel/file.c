@@ -112,7 +112,7 @@ fileread(struct file *f, uint64 addr, int n)
     return -1;
 
   if(f->type == FD_PIPE){
-    r = piperead(f->pipe, addr, n);
+    r = piperead(f->pipe, 1, addr, n);
   } else if(f->type == FD_DEVICE){
     r = devsw[f->major].read(1, addr, n);
   } else if(f->type == FD_INODE){
@@ -127,48 +127,69 @@ fileread(struct file *f, uint64 addr, int n)
   return r;
 }
 
+// Write n bytes from src to f's inode at offset *off,
+// advancing *off as they are written.  If user_src==1,
+// then src is a user virtual address; otherwise, src is
+// a kernel address.  Returns the number of bytes written.
+static int
+writeinode(struct file *f, int user_src, uint64 src, uint *off, int n)
+{
+  int r;
+
+  // write up to half the log's worth of blocks per
+  // transaction, reserving room for them plus the
+  // i-node, indirect block, and 2 bitmap blocks; writei()
+  // allocates each chunk's new blocks as contiguous runs.
+  // the 2 blocks of slop are for non-aligned writes.
+  // if file data bypasses the log, only that metadata
+  // needs room, and a chunk can be much bigger.
+  // this really belongs lower down, since writei()
+  // might be writing a device like the console.
+  int nblocks = log_max(f->ip->dev)/2;
+  int reserve = nblocks + 4;
+  if(log_ordered(f->ip->dev)){
+    nblocks = 64;
+    reserve = 4;
+  }
+  int max = (nblocks-2) * BSIZE;
+  int i = 0;
+  while(i < n){
+    int n1 = n - i;
+    if(n1 > max)
+      n1 = max;
+
+    begin_opn(f->ip->dev, reserve);
+    ilock(f->ip);
+    if ((r = writei(f->ip, user_src, src + i, *off, n1)) > 0)
+      *off += r;
+    iunlock(f->ip);
+    end_opn(f->ip->dev, reserve);
+
+    if(r < 0)
+      break;
+    if(r != n1)
+      panic("short filewrite");
+    i += r;
+  }
+  return i;
+}
+
 // Write to file f.
 // addr is a user virtual address.
 int
 filewrite(struct file *f, uint64 addr, int n)
 {
-  int r, ret = 0;
+  int ret = 0;
 
   if(f->writable == 0)
     return -1;
 
   if(f->type == FD_PIPE){
-    ret = pipewrite(f->pipe, addr, n);
+    ret = pipewrite(f->pipe, 1, addr, n);
   } else if(f->type == FD_DEVICE){
     ret = devsw[f->major].write(1, addr, n);
   } else if(f->type == FD_INODE){
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
-    // this really belongs lower down, since writei()
-    // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
-    int i = 0;
-    while(i < n){
-      int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
-
-      begin_op(f->ip->dev);
-      ilock(f->ip);
-      if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
-        f->off += r;
-      iunlock(f->ip);
-      end_op(f->ip->dev);
-
-      if(r < 0)
-        break;
-      if(r != n1)
-        panic("short filewrite");
-      i += r;
-    }
-    ret = (i == n ? n : -1);
+    ret = (writeinode(f, 1, addr, &f->off, n) == n ? n : -1);
   } else {
     panic("filewrite");
   }
@@ -176,3 +197,165 @@ filewrite(struct file *f, uint64 addr, int n)
   return ret;
 }
 
+
+// Read from file f at offset off, without using or
+// changing f's own offset.
+int
+filepread(struct file *f, uint64 addr, int n, uint off)
+{
+  int r;
+
+  if(f->readable == 0 || f->type != FD_INODE)
+    return -1;
+  ilock(f->ip);
+  r = readi(f->ip, 1, addr, off, n);
+  iunlock(f->ip);
+  return r;
+}
+
+// Write to file f at offset off, without using or
+// changing f's own offset.
+int
+filepwrite(struct file *f, uint64 addr, int n, uint off)
+{
+  if(f->writable == 0 || f->type != FD_INODE)
+    return -1;
+  return writeinode(f, 1, addr, &off, n) == n ? n : -1;
+}
+
+// Wait until f's earlier writes are on disk.
+int
+filesync(struct file *f)
+{
+  if(f->type != FD_INODE)
+    return -1;
+  log_force(f->ip->dev);
+  return 0;
+}
+
+// Set the size of file f to size bytes, freeing blocks
+// past a smaller size, or appending zeros up to a larger one.
+int
+filetruncate(struct file *f, uint size)
+{
+  struct inode *ip = f->ip;
+  char *zeros;
+  uint cur;
+  int n;
+
+  if(f->writable == 0 || f->type != FD_INODE || size > MAXFILE*BSIZE)
+    return -1;
+
+  begin_op(ip->dev);
+  ilock(ip);
+  if(ip->type != T_FILE){
+    iunlock(ip);
+    end_op(ip->dev);
+    return -1;
+  }
+  itruncate(ip, size);
+  cur = ip->size;
+  iunlock(ip);
+  end_op(ip->dev);
+
+  if(cur < size){
+    if((zeros = kalloc()) == 0)
+      return -1;
+    memset(zeros, 0, PGSIZE);
+    while(cur < size){
+      n = size - cur < PGSIZE ? size - cur : PGSIZE;
+      if(writeinode(f, 0, (uint64)zeros, &cur, n) != n)
+        break;
+    }
+    kfree(zeros);
+  }
+  return cur == size ? 0 : -1;
+}
+
+// Move up to n bytes from file in to file out without
+// copying them through user space, a page at a time.
+// Reads from an i-node are at *inoff, which is advanced;
+// writes to one are at out's own offset.  Data read from a
+// file goes from the buffer cache into a page that is then
+// handed to an output pipe whole.  Stops early after a short
+// read from a pipe or device, like read() would return.
+// Returns the number of bytes moved, or -1 if none could be.
+static int
+filemove(struct file *out, struct file *in, uint *inoff, int n)
+{
+  char *page;
+  int i, m, r, w;
+
+  if(in->readable == 0 || out->writable == 0 || n < 0)
+    return -1;
+
+  for(i = 0; i < n; i += r){
+    if((page = kalloc()) == 0)
+      break;
+    m = n - i < PGSIZE ? n - i : PGSIZE;
+
+    if(in->type == FD_INODE){
+      ilock(in->ip);
+      if((r = readi(in->ip, 0, (uint64)page, *inoff, m)) > 0)
+        *inoff += r;
+      iunlock(in->ip);
+    } else if(in->type == FD_PIPE){
+      r = piperead(in->pipe, 0, (uint64)page, m);
+    } else {
+      r = devsw[in->major].read(0, (uint64)page, m);
+    }
+    if(r <= 0){
+      kfree(page);
+      break;
+    }
+
+    if(out->type == FD_PIPE){
+      if(pipeputpage(out->pipe, page, r) == 0)
+        page = 0;
+      else
+        w = -1;
+    } else if(out->type == FD_INODE){
+      w = writeinode(out, 0, (uint64)page, &out->off, r);
+    } else {
+      w = devsw[out->major].write(0, (uint64)page, r);
+    }
+    if(page){
+      kfree(page);
+      if(w != r)
+        return i > 0 ? i : -1;
+    }
+    if(r < m && in->type != FD_INODE)
+      return i + r;
+  }
+  return i > 0 || n == 0 ? i : -1;
+}
+
+// Copy n bytes of file in, starting at offset off, to out.
+// If off is -1, start at in's own offset and advance it.
+int
+filesendfile(struct file *out, struct file *in, int off, int n)
+{
+  uint o;
+  int r;
+
+  if(in->type != FD_INODE)
+    return -1;
+  if(off >= 0){
+    o = off;
+    return filemove(out, in, &o, n);
+  }
+  o = in->off;
+  r = filemove(out, in, &o, n);
+  in->off = o;
+  return r;
+}
+
+// Move n bytes from in to out, at least one of which
+// must be a pipe, using and advancing their offsets.
+int
+filesplice(struct file *in, struct file *out, int n)
+{
+  if(in->type != FD_PIPE && out->type != FD_PIPE)
+    return -1;
+  return filemove(out, in, &in->off, n);
+}
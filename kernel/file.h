@@ -18,6 +18,9 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  struct inode *hnext; // icache hash chain
+  struct inode *prev; // icache LRU list of unreferenced inodes
+  struct inode *next;
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
@@ -27,6 +30,9 @@ struct inode {
   short nlink;
   uint size;
   uint addrs[NDIRECT+1];
+
+  uint dirfree;       // directories: no free dirent below this offset,
+                      // outside an index's leaves
 };
 
 // map major device number to device functions.
@@ -39,3 +45,5 @@ extern struct devsw devsw[];
 
 #define DISK 0
 #define CONSOLE 1
+#define PROF 2
+#define TRACE 3
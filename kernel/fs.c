@@ -22,7 +22,9 @@
 #include "file.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
 static void itrunc(struct inode*);
+static void ifree(struct inode*, uint);
 // there should be one superblock per disk device, but we run with
 // only one device
 struct superblock sb; 
@@ -38,6 +40,8 @@ readsb(int dev, struct superblock *sb)
   brelse(bp);
 }
 
+static void bsuminit(int);
+
 // Init fs
 void
 fsinit(int dev) {
@@ -45,6 +49,7 @@ fsinit(int dev) {
   if(sb.magic != FSMAGIC)
     panic("invalid file system");
   initlog(dev, &sb);
+  bsuminit(dev);
 }
 
 // Zero a block.
@@ -60,32 +65,146 @@ bzero(int dev, int bno)
 }
 
 // Blocks.
+//
+// The disk is divided into groups of BGROUP blocks, and bsum
+// keeps the number of free blocks in each group, so that
+// balloc() can skip full groups without looking at their
+// bitmap bits.  A group's count changes only while its bitmap
+// block is locked (by bread), which keeps it exact; balloc()
+// reads the counts of other groups without that lock, as hints.
 
-// Allocate a zeroed disk block.
-static uint
-balloc(uint dev)
+#define BGROUP 512    // blocks per group; divides BPB
+#define NBGROUP ((FSSIZE + BGROUP - 1) / BGROUP)
+
+struct {
+  uint nfree[NBGROUP];
+  int ngroups;
+  // On an ordered file system, blocks freed by the running
+  // transaction; balloc() treats them as in use.
+  uint64 freed[NBGROUP * BGROUP / 64];
+  int anyfreed;
+} bsum;
+
+// Count the free blocks in each group.
+static void
+bsuminit(int dev)
 {
-  int b, bi, m;
   struct buf *bp;
+  uint b;
 
+  bsum.ngroups = (sb.size + BGROUP - 1) / BGROUP;
+  if(bsum.ngroups > NBGROUP)
+    panic("bsuminit: file system too big");
   bp = 0;
-  for(b = 0; b < sb.size; b += BPB){
-    bp = bread(dev, BBLOCK(b, sb));
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
-      m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
-        bp->data[bi/8] |= m;  // Mark block in use.
-        log_write(bp);
+  for(b = 0; b < sb.size; b++){
+    if(b % BPB == 0){
+      if(bp)
         brelse(bp);
-        bzero(dev, b + bi);
-        return b + bi;
+      bp = bread(dev, BBLOCK(b, sb));
+    }
+    if((bp->data[(b % BPB)/8] & (1 << (b % 8))) == 0)
+      bsum.nfree[b / BGROUP]++;
+  }
+  if(bp)
+    brelse(bp);
+}
+
+// Called by the log once a transaction has committed:
+// the blocks it freed may now be reused.
+// Returns 1 if there were any, else 0.
+int
+bcommit(int dev)
+{
+  if(bsum.anyfreed){
+    memset(bsum.freed, 0, sizeof(bsum.freed));
+    bsum.anyfreed = 0;
+    return 1;
+  }
+  return 0;
+}
+
+static int
+bfreed(uint b)
+{
+  return (bsum.freed[b/64] & (1ULL << (b % 64))) != 0;
+}
+
+// Find a bit that is clear in bitmap map, whose first bit is
+// for block base, and not set in bsum.freed, between bits from
+// and to, looking at a 64-bit word at a time.  Returns the
+// bit's index, or -1 if all are set.
+static int
+bscan(uchar *map, uint base, uint from, uint to)
+{
+  uint64 w;
+  uint i;
+
+  for(i = from; i < to; i = (i + 64) & ~63){
+    w = ((uint64*)map)[i / 64] | ((1ULL << (i % 64)) - 1);
+    if(bsum.anyfreed)
+      w |= bsum.freed[(base + i) / 64];
+    if(w == ~0ULL)
+      continue;
+    for(i &= ~63; w & 1; w >>= 1)
+      i++;
+    return i < to ? i : -1;
+  }
+  return -1;
+}
+
+// Allocate a run of up to n contiguous disk blocks, zeroed
+// if zero is set, starting as close after goal as possible:
+// in goal's group, then in the following groups.  Returns the
+// first block and sets *got to the length of the run.
+static uint
+ballocrun(uint dev, uint goal, uint n, int zero, uint *got)
+{
+  int bi;
+  uint g, from, to, k, b, m;
+  struct buf *bp;
+
+  if(goal >= sb.size)
+    goal = 0;
+  for(k = 0; k <= bsum.ngroups; k++){
+    // last, wrap around to the part of goal's group before goal.
+    g = (goal / BGROUP + k) % bsum.ngroups;
+    from = k == 0 ? goal : g * BGROUP;
+    to = k == bsum.ngroups ? goal : min((g + 1) * BGROUP, sb.size);
+    if(bsum.nfree[g] == 0 || from >= to)
+      continue;
+    bp = bread(dev, BBLOCK(from, sb));
+    bi = bscan(bp->data, from - from % BPB, from % BPB, from % BPB + (to - from));
+    if(bi >= 0){
+      // Mark the block and any free ones right after it in use.
+      b = from - from % BPB + bi;
+      to = min((g + 1) * BGROUP, sb.size);
+      for(m = 0; m < n && b + m < to; m++, bi++){
+        if((bp->data[bi/8] & (1 << (bi % 8))) || bfreed(b + m))
+          break;
+        bp->data[bi/8] |= 1 << (bi % 8);
       }
+      bsum.nfree[g] -= m;
+      log_write(bp);
+      brelse(bp);
+      for(k = 0; zero && k < m; k++)
+        bzero(dev, b + k);
+      *got = m;
+      return b;
     }
     brelse(bp);
   }
   panic("balloc: out of blocks");
 }
 
+// Allocate a zeroed disk block near goal.
+static uint
+balloc(uint dev, uint goal)
+{
+  uint got;
+
+  return ballocrun(dev, goal, 1, 1, &got);
+}
+
 // Free a disk block.
 static void
 bfree(int dev, uint b)
@@ -99,6 +218,11 @@ bfree(int dev, uint b)
   if((bp->data[bi/8] & m) == 0)
     panic("freeing free block");
   bp->data[bi/8] &= ~m;
+  bsum.nfree[b / BGROUP]++;
+  if(log_ordered(dev)){
+    bsum.freed[b/64] |= 1ULL << (b % 64);
+    bsum.anyfreed = 1;
+  }
   log_write(bp);
   brelse(bp);
 }
@@ -128,18 +252,18 @@ bfree(int dev, uint b)
 //   is non-zero. ialloc() allocates, and iput() frees if
 //   the reference and link counts have fallen to zero.
 //
-// * Referencing in cache: an entry in the inode cache
-//   is free if ip->ref is zero. Otherwise ip->ref tracks
-//   the number of in-memory pointers to the entry (open
-//   files and current directories). iget() finds or
-//   creates a cache entry and increments its ref; iput()
-//   decrements ref.
+// * Referencing in cache: ip->ref tracks the number of
+//   in-memory pointers to the entry (open files and current
+//   directories). iget() finds or creates a cache entry and
+//   increments its ref; iput() decrements ref.  An entry
+//   whose ref is zero still holds its inode until iget()
+//   recycles it for another, least recently used first.
 //
 // * Valid: the information (type, size, &c) in an inode
 //   cache entry is only correct when ip->valid is 1.
-//   ilock() reads the inode from
-//   the disk and sets ip->valid, while iput() clears
-//   ip->valid if ip->ref has fallen to zero.
+//   ilock() reads the inode from the disk and sets
+//   ip->valid, while iput() clears ip->valid when it frees
+//   the inode and iget() when it recycles the entry.
 //
 // * Locked: file system code may only examine and modify
 //   the information in an inode and its content if it
@@ -163,28 +287,142 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
-// The icache.lock spin-lock protects the allocation of icache
-// entries. Since ip->ref indicates whether an entry is free,
-// and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold icache.lock while using any of those fields.
+// The cache is a hash table of entries keyed by (dev, inum),
+// with a spin-lock per bucket.  A bucket's lock protects the
+// ip->ref, ip->dev, ip->inum and ip->hnext fields of the
+// entries in it, so that iget(), idup() and iput() of
+// different inodes don't contend.  Entries with ref zero are
+// also on the icache.lru list, most recently used first,
+// protected by icache.lock; entries that hold no inode at all
+// (inum zero) are on the list too, at the end.  Moving an entry
+// on or off the list requires both its bucket's lock and
+// icache.lock, acquired in that order.  The cache starts with
+// NINODE entries and takes another page of them from kalloc()
+// when every entry is in use.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
-// dev, and inum.  One must hold ip->lock in order to
+// dev, inum and the list links.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
+#define NIHASH 31
+#define IHASH(dev, inum) (((dev)*7 + (inum)) % NIHASH)
+
+struct ibucket {
+  struct spinlock lock;
+  struct inode *head;
+};
+
 struct {
   struct spinlock lock;
   struct inode inode[NINODE];
+  struct ibucket bucket[NIHASH];
+
+  // Linked list of entries with ref zero, through prev/next.
+  // lru.next is most recently used.
+  struct inode lru;
 } icache;
 
+// Put ip, whose ref has fallen to zero, on the list:
+// at the front if it still holds an inode, else at the end.
+// Caller must hold icache.lock.
+static void
+lruput(struct inode *ip)
+{
+  if(ip->inum){
+    ip->next = icache.lru.next;
+    ip->prev = &icache.lru;
+  } else {
+    ip->next = &icache.lru;
+    ip->prev = icache.lru.prev;
+  }
+  ip->next->prev = ip;
+  ip->prev->next = ip;
+}
+
+// Caller must hold icache.lock.
+static void
+lruremove(struct inode *ip)
+{
+  ip->next->prev = ip->prev;
+  ip->prev->next = ip->next;
+  ip->next = ip->prev = 0;
+}
+
 void
 iinit()
 {
   int i = 0;
   
   initlock(&icache.lock, "icache");
+  for(i = 0; i < NIHASH; i++)
+    initlock(&icache.bucket[i].lock, "icache.bucket");
+  icache.lru.prev = &icache.lru;
+  icache.lru.next = &icache.lru;
   for(i = 0; i < NINODE; i++) {
     initsleeplock(&icache.inode[i].lock, "inode");
+    lruput(&icache.inode[i]);
+  }
+}
+
+// Add a page of empty entries to the cache.
+// Caller must hold icache.lock.
+static void
+igrow(void)
+{
+  struct inode *ip, *page;
+
+  if((page = (struct inode*)kalloc()) == 0)
+    panic("iget: no inodes");
+  memset(page, 0, PGSIZE);
+  for(ip = page; ip < page + PGSIZE/sizeof(*ip); ip++){
+    initsleeplock(&ip->lock, "inode");
+    lruput(ip);
+  }
+}
+
+// Take an entry with ref zero off the list, least recently
+// used first, and out of its hash bucket.  Grows the cache
+// if every entry is in use.  The entry is returned holding
+// no inode and on no list.
+static struct inode*
+irecycle(void)
+{
+  struct inode *ip;
+  struct ibucket *b;
+
+  for(;;){
+    acquire(&icache.lock);
+    if((ip = icache.lru.prev) == &icache.lru){
+      igrow();
+      ip = icache.lru.prev;
+    }
+    if(ip->inum == 0){
+      lruremove(ip);
+      release(&icache.lock);
+      return ip;
+    }
+    b = &icache.bucket[IHASH(ip->dev, ip->inum)];
+    release(&icache.lock);
+
+    // Take the locks in order, then make sure ip didn't
+    // change hands in between.
+    acquire(&b->lock);
+    acquire(&icache.lock);
+    if(ip->ref == 0 && ip->next != 0 && ip->inum &&
+       b == &icache.bucket[IHASH(ip->dev, ip->inum)]){
+      struct inode **pp;
+      for(pp = &b->head; *pp != ip; pp = &(*pp)->hnext)
+        ;
+      *pp = ip->hnext;
+      lruremove(ip);
+      ip->inum = 0;
+      ip->valid = 0;
+      release(&icache.lock);
+      release(&b->lock);
+      return ip;
+    }
+    release(&icache.lock);
+    release(&b->lock);
   }
 }
 
@@ -237,38 +475,60 @@ iupdate(struct inode *ip)
   brelse(bp);
 }
 
+// Look for the inode in bucket b and take a reference to it.
+// Caller must hold b->lock.
+static struct inode*
+ifind(struct ibucket *b, uint dev, uint inum)
+{
+  struct inode *ip;
+
+  for(ip = b->head; ip; ip = ip->hnext){
+    if(ip->dev == dev && ip->inum == inum){
+      if(ip->ref++ == 0){
+        acquire(&icache.lock);
+        lruremove(ip);
+        release(&icache.lock);
+      }
+      return ip;
+    }
+  }
+  return 0;
+}
+
 // Find the inode with number inum on device dev
 // and return the in-memory copy. Does not lock
 // the inode and does not read it from disk.
 static struct inode*
 iget(uint dev, uint inum)
 {
+  struct ibucket *b = &icache.bucket[IHASH(dev, inum)];
   struct inode *ip, *empty;
 
-  acquire(&icache.lock);
-
   // Is the inode already cached?
-  empty = 0;
-  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
-      release(&icache.lock);
-      return ip;
-    }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
+  acquire(&b->lock);
+  ip = ifind(b, dev, inum);
+  release(&b->lock);
+  if(ip)
+    return ip;
+
+  // Recycle an inode cache entry, unless someone else
+  // cached the inode while b->lock was released.
+  empty = irecycle();
+  acquire(&b->lock);
+  if((ip = ifind(b, dev, inum)) != 0){
+    acquire(&icache.lock);
+    lruput(empty);
+    release(&icache.lock);
+  } else {
+    ip = empty;
+    ip->dev = dev;
+    ip->inum = inum;
+    ip->ref = 1;
+    ip->valid = 0;
+    ip->hnext = b->head;
+    b->head = ip;
   }
-
-  // Recycle an inode cache entry.
-  if(empty == 0)
-    panic("iget: no inodes");
-
-  ip = empty;
-  ip->dev = dev;
-  ip->inum = inum;
-  ip->ref = 1;
-  ip->valid = 0;
-  release(&icache.lock);
+  release(&b->lock);
 
   return ip;
 }
@@ -278,9 +538,11 @@ iget(uint dev, uint inum)
 struct inode*
 idup(struct inode *ip)
 {
-  acquire(&icache.lock);
+  struct ibucket *b = &icache.bucket[IHASH(ip->dev, ip->inum)];
+
+  acquire(&b->lock);
   ip->ref++;
-  release(&icache.lock);
+  release(&b->lock);
   return ip;
 }
 
@@ -307,6 +569,7 @@ ilock(struct inode *ip)
     ip->size = dip->size;
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
     brelse(bp);
+    ip->dirfree = 0;
     ip->valid = 1;
     if(ip->type == 0)
       panic("ilock: no type");
@@ -333,7 +596,9 @@ iunlock(struct inode *ip)
 void
 iput(struct inode *ip)
 {
-  acquire(&icache.lock);
+  struct ibucket *b = &icache.bucket[IHASH(ip->dev, ip->inum)];
+
+  acquire(&b->lock);
 
   if(ip->ref == 1 && ip->valid && ip->nlink == 0){
     // inode has no links and no other references: truncate and free.
@@ -342,8 +607,10 @@ iput(struct inode *ip)
     // so this acquiresleep() won't block (or deadlock).
     acquiresleep(&ip->lock);
 
-    release(&icache.lock);
+    release(&b->lock);
 
+    if(ip->type == T_DIR)
+      dcachepurge(ip->dev, ip->inum);
     itrunc(ip);
     ip->type = 0;
     iupdate(ip);
@@ -351,11 +618,15 @@ iput(struct inode *ip)
 
     releasesleep(&ip->lock);
 
-    acquire(&icache.lock);
+    acquire(&b->lock);
   }
 
-  ip->ref--;
-  release(&icache.lock);
+  if(--ip->ref == 0){
+    acquire(&icache.lock);
+    lruput(ip);
+    release(&icache.lock);
+  }
+  release(&b->lock);
 }
 
 // Common idiom: unlock, then put.
@@ -373,17 +644,30 @@ iunlockput(struct inode *ip)
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
 // listed in block ip->addrs[NDIRECT].
 
+// Where to allocate a block that follows block prev of inode
+// ip: right after prev, or, for the inode's first block, in
+// a group chosen by inode number, so that files written at
+// the same time don't interleave their blocks.
+static uint
+bgoal(struct inode *ip, uint prev)
+{
+  if(prev)
+    return prev + 1;
+  return (ip->inum % bsum.ngroups) * BGROUP;
+}
+
 // Return the disk block address of the nth block in inode ip.
-// If there is no such block, bmap allocates one.
+// If there is no such block, bmap uses block new if it is
+// not zero, else allocates one.
 static uint
-bmap(struct inode *ip, uint bn)
+bmapnew(struct inode *ip, uint bn, uint new)
 {
   uint addr, *a;
   struct buf *bp;
 
   if(bn < NDIRECT){
     if((addr = ip->addrs[bn]) == 0)
-      ip->addrs[bn] = addr = balloc(ip->dev);
+      ip->addrs[bn] = addr = new ? new : balloc(ip->dev, bgoal(ip, bn ? ip->addrs[bn-1] : 0));
     return addr;
   }
   bn -= NDIRECT;
@@ -391,11 +675,11 @@ bmap(struct inode *ip, uint bn)
   if(bn < NINDIRECT){
     // Load indirect block, allocating if necessary.
     if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
+      ip->addrs[NDIRECT] = addr = balloc(ip->dev, bgoal(ip, ip->addrs[NDIRECT-1]));
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
     if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
+      a[bn] = addr = new ? new : balloc(ip->dev, bgoal(ip, bn ? a[bn-1] : ip->addrs[NDIRECT]));
       log_write(bp);
     }
     brelse(bp);
@@ -405,6 +689,69 @@ bmap(struct inode *ip, uint bn)
   panic("bmap: out of range");
 }
 
+static uint
+bmap(struct inode *ip, uint bn)
+{
+  return bmapnew(ip, bn, 0);
+}
+
+// Return the end of the run of blocks of ip, from block bn up
+// to at most nb, that aren't mapped yet; bn if bn is mapped.
+static uint
+bunmapped(struct inode *ip, uint bn, uint nb)
+{
+  struct buf *bp;
+  uint *a;
+
+  for(; bn < nb && bn < NDIRECT; bn++)
+    if(ip->addrs[bn])
+      return bn;
+  if(bn >= nb || ip->addrs[NDIRECT] == 0)
+    return nb;
+  bp = bread(ip->dev, ip->addrs[NDIRECT]);
+  a = (uint*)bp->data;
+  for(; bn < nb && a[bn - NDIRECT] == 0; bn++)
+    ;
+  brelse(bp);
+  return bn;
+}
+
+// Allocate the blocks that will hold bytes [ip->size, end) of
+// ip, as a few contiguous runs rather than one block at a time
+// as writei() reaches them, so that a large write lays the file
+// out sequentially even while others allocate blocks too.
+// Data blocks that bypass the log aren't zeroed: writei() fills
+// them up to the new end of the file, and nothing past the end
+// is ever read.
+static void
+iextend(struct inode *ip, uint end)
+{
+  uint bn, nb, e, prev, b, got;
+  int zero = !(ip->type == T_FILE && log_ordered(ip->dev));
+
+  bn = (ip->size + BSIZE - 1) / BSIZE;
+  nb = min((end + BSIZE - 1) / BSIZE, MAXFILE);
+  while(bn < nb){
+    if(bn == NDIRECT && ip->addrs[NDIRECT] == 0){
+      // put the indirect block ahead of the run.
+      ip->addrs[NDIRECT] = balloc(ip->dev, bgoal(ip, ip->addrs[NDIRECT-1]));
+    }
+    // a failed earlier writei() may have left blocks mapped
+    // past the end of the file; allocate only around them.
+    e = bunmapped(ip, bn, bn < NDIRECT ? min(nb, NDIRECT) : nb);
+    if(e == bn){
+      bn++;
+      continue;
+    }
+    prev = bn == 0 ? 0 : bmap(ip, bn - 1);
+    if(bn == NDIRECT)
+      prev = ip->addrs[NDIRECT];
+    b = ballocrun(ip->dev, bgoal(ip, prev), e - bn, zero, &got);
+    for(; got > 0; got--, bn++, b++)
+      bmapnew(ip, bn, b);
+  }
+}
+
 // Truncate inode (discard contents).
 // Only called when the inode has no links
 // to it (no directory entries referring to it)
@@ -413,11 +760,20 @@ bmap(struct inode *ip, uint bn)
 static void
 itrunc(struct inode *ip)
 {
-  int i, j;
+  ifree(ip, 0);
+  ip->size = 0;
+  iupdate(ip);
+}
+
+// Free the data blocks of ip from block bn of the file on.
+static void
+ifree(struct inode *ip, uint bn)
+{
+  int i, j, keep;
   struct buf *bp;
   uint *a;
 
-  for(i = 0; i < NDIRECT; i++){
+  for(i = bn; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
       ip->addrs[i] = 0;
@@ -425,18 +781,39 @@ itrunc(struct inode *ip)
   }
 
   if(ip->addrs[NDIRECT]){
+    keep = bn > NDIRECT;
     bp = bread(ip->dev, ip->addrs[NDIRECT]);
     a = (uint*)bp->data;
-    for(j = 0; j < NINDIRECT; j++){
-      if(a[j])
+    for(j = keep ? bn - NDIRECT : 0; j < NINDIRECT; j++){
+      if(a[j]){
         bfree(ip->dev, a[j]);
+        if(keep)
+          a[j] = 0;
+      }
     }
+    if(keep)
+      log_write(bp);
     brelse(bp);
-    bfree(ip->dev, ip->addrs[NDIRECT]);
-    ip->addrs[NDIRECT] = 0;
+    if(!keep){
+      bfree(ip->dev, ip->addrs[NDIRECT]);
+      ip->addrs[NDIRECT] = 0;
+    }
   }
+}
 
-  ip->size = 0;
+// Shrink file ip to size bytes, freeing the blocks
+// past its new end.  The bytes after size in its last
+// block are left alone: writei() can only grow a file
+// from its end, so they are overwritten before they
+// can be read.
+// Caller must hold ip->lock and be in a transaction.
+void
+itruncate(struct inode *ip, uint size)
+{
+  if(size >= ip->size)
+    return;
+  ifree(ip, (size + BSIZE - 1) / BSIZE);
+  ip->size = size;
   iupdate(ip);
 }
 
@@ -488,11 +865,15 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
 {
   uint tot, m;
   struct buf *bp;
+  int ordered;
 
   if(off > ip->size || off + n < off)
     return -1;
   if(off + n > MAXFILE*BSIZE)
     return -1;
+  if(off + n > ip->size)
+    iextend(ip, off + n);
+  ordered = ip->type == T_FILE && log_ordered(ip->dev);
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
@@ -501,7 +882,10 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
       brelse(bp);
       break;
     }
-    log_write(bp);
+    if(ordered)
+      bwrite(bp);  // home now, ahead of the commit
+    else
+      log_write(bp);
     brelse(bp);
   }
 
@@ -520,31 +904,257 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
+static int
+isdot(char *name)
+{
+  return namecmp(name, ".") == 0 || namecmp(name, "..") == 0;
+}
+
+// Hash a directory entry name (FNV-1a).
+// mkfs has a copy; the two must agree.
+static uint
+dirhash(char *name)
+{
+  uint h = 2166136261;
+
+  for(int i = 0; i < DIRSIZ && name[i]; i++){
+    h ^= (uchar)name[i];
+    h *= 16777619;
+  }
+  return h;
+}
+
+// Search block bn of directory dp for an entry named name,
+// or for a free entry if name is 0.
+// Returns the byte offset of the entry and sets *pinum to its
+// inum, or returns -1 if there is none.
+static int
+dirscan(struct inode *dp, uint bn, char *name, uint *pinum)
+{
+  struct buf *bp;
+  struct dirent *de, *end;
+  int off;
+
+  bp = bread(dp->dev, bmap(dp, bn));
+  end = (struct dirent*)(bp->data + min(BSIZE, dp->size - bn*BSIZE));
+  off = -1;
+  for(de = (struct dirent*)bp->data; de < end; de++){
+    if(name ? de->inum != 0 && namecmp(name, de->name) == 0 : de->inum == 0){
+      off = bn*BSIZE + (char*)de - (char*)bp->data;
+      if(pinum)
+        *pinum = de->inum;
+      break;
+    }
+  }
+  brelse(bp);
+  return off;
+}
+
+// If dp is indexed, find the leaf for hash h: set *pi to its
+// index entry and *pbn to its block, and return the number of
+// leaves.  Returns 0 if dp is not indexed.
+static int
+dxlookup(struct inode *dp, uint h, int *pi, uint *pbn)
+{
+  struct buf *bp;
+  struct dxentry *dx;
+  int lo, hi, mid, n;
+
+  if(dp->size < 3*BSIZE)
+    return 0;
+  bp = bread(dp->dev, bmap(dp, 1));
+  dx = (struct dxentry*)bp->data;
+  if(dx[0].zero != 0 || dx[0].hash != DXMAGIC){
+    brelse(bp);
+    return 0;
+  }
+  n = dx[0].block;
+  // find the last entry whose hash is <= h; dx[1].hash is 0.
+  lo = 1;
+  hi = n;
+  while(lo < hi){
+    mid = (lo + hi + 1) / 2;
+    if(dx[mid].hash <= h)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  *pi = lo;
+  *pbn = dx[lo].block;
+  brelse(bp);
+  return n;
+}
+
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
+// Callers that don't need the offset may be answered
+// from the dcache without reading the directory.
 struct inode*
 dirlookup(struct inode *dp, char *name, uint *poff)
 {
-  uint off, inum;
-  struct dirent de;
+  uint bn, nb, inum;
+  int i, n, off;
 
   if(dp->type != T_DIR)
     panic("dirlookup not DIR");
 
-  for(off = 0; off < dp->size; off += sizeof(de)){
-    if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlookup read");
-    if(de.inum == 0)
-      continue;
-    if(namecmp(name, de.name) == 0){
-      // entry matches path element
-      if(poff)
-        *poff = off;
-      inum = de.inum;
-      return iget(dp->dev, inum);
+  if(poff == 0 && dcachelookup(dp->dev, dp->inum, name, &inum))
+    return inum ? iget(dp->dev, inum) : 0;
+
+  off = -1;
+  nb = (dp->size + BSIZE - 1) / BSIZE;
+  if((n = dxlookup(dp, dirhash(name), &i, &bn)) > 0){
+    // only the name's leaf, then any overflow blocks.
+    if(isdot(name))
+      off = dirscan(dp, 0, name, &inum);
+    else
+      off = dirscan(dp, bn, name, &inum);
+    bn = n + 2;
+  } else {
+    bn = 0;
+  }
+  for(; off < 0 && bn < nb; bn++)
+    off = dirscan(dp, bn, name, &inum);
+
+  if(off < 0){
+    dcacheenter(dp->dev, dp->inum, name, 0);
+    return 0;
+  }
+  // entry matches path element
+  if(poff)
+    *poff = off;
+  dcacheenter(dp->dev, dp->inum, name, inum);
+  return iget(dp->dev, inum);
+}
+
+// Find a free dirent in the unindexed blocks of dp,
+// starting at block first.  Returns dp->size if there is none.
+static uint
+dirfreeslot(struct inode *dp, uint first)
+{
+  uint bn, nb;
+  int off;
+
+  nb = (dp->size + BSIZE - 1) / BSIZE;
+  for(bn = max(first, dp->dirfree / BSIZE); bn < nb; bn++){
+    if((off = dirscan(dp, bn, 0, 0)) >= 0)
+      return dp->dirfree = off;
+  }
+  return dp->dirfree = dp->size;
+}
+
+// Turn dp, whose first and only block is full, into an indexed
+// directory with one leaf holding all but "." and "..".  The
+// rest of block 0 is left empty and is never used again:
+// dirlink() puts names only in leaves and overflow blocks, and
+// dirlookup() looks in block 0 only for "." and "..".  That
+// wastes DPB-2 slots, but keeps every other name where the
+// index or the overflow scan will find it.
+static void
+dirindex(struct inode *dp)
+{
+  struct buf *bp, *lp;
+  struct dirent *de, *lde;
+  struct dxentry *dx;
+
+  bmap(dp, 1);
+  bmap(dp, 2);
+  dp->size = 3*BSIZE;
+  iupdate(dp);
+
+  bp = bread(dp->dev, bmap(dp, 0));
+  lp = bread(dp->dev, bmap(dp, 2));
+  lde = (struct dirent*)lp->data;
+  for(de = (struct dirent*)bp->data; de < (struct dirent*)bp->data + DPB; de++){
+    if(de->inum != 0 && !isdot(de->name)){
+      *lde++ = *de;
+      memset(de, 0, sizeof(*de));
     }
   }
+  log_write(bp);
+  log_write(lp);
+  brelse(bp);
+  brelse(lp);
+
+  bp = bread(dp->dev, bmap(dp, 1));
+  dx = (struct dxentry*)bp->data;
+  memset(dx, 0, BSIZE);
+  dx[0].hash = DXMAGIC;
+  dx[0].block = 1;
+  dx[1].hash = 0;
+  dx[1].block = 2;
+  log_write(bp);
+  brelse(bp);
+}
 
+// Split leaf i, block bn, of dp's n-leaf index, moving the
+// names in the upper half of its range of hashes to a new leaf.
+// Returns 0, or -1 if the leaf can't be split.
+static int
+dirsplit(struct inode *dp, int i, uint bn, int n)
+{
+  uint h[DPB], split, nb, x;
+  int j, k, m;
+  struct buf *bp, *np;
+  struct dirent *de, *nde;
+  struct dxentry *dx;
+
+  // the index is full, or overflow blocks follow the leaves.
+  if(n >= DXPB - 1 || dp->size != (n + 2)*BSIZE || n + 2 >= MAXFILE)
+    return -1;
+
+  // sort the leaf's hashes and pick a split point near the
+  // middle that doesn't separate equal hashes.
+  bp = bread(dp->dev, bmap(dp, bn));
+  m = 0;
+  for(de = (struct dirent*)bp->data; de < (struct dirent*)bp->data + DPB; de++){
+    if(de->inum == 0)
+      continue;
+    x = dirhash(de->name);
+    for(k = m++; k > 0 && h[k-1] > x; k--)
+      h[k] = h[k-1];
+    h[k] = x;
+  }
+  brelse(bp);
+  if(m < 2)
+    return -1;
+  for(k = m/2; k < m && h[k] == h[k-1]; k++)
+    ;
+  if(k == m)
+    for(k = m/2; k > 0 && h[k] == h[k-1]; k--)
+      ;
+  if(k == 0)
+    return -1;
+  split = h[k];
+
+  nb = n + 2;
+  bmap(dp, nb);
+  dp->size += BSIZE;
+  iupdate(dp);
+
+  bp = bread(dp->dev, bmap(dp, bn));
+  np = bread(dp->dev, bmap(dp, nb));
+  nde = (struct dirent*)np->data;
+  for(de = (struct dirent*)bp->data; de < (struct dirent*)bp->data + DPB; de++){
+    if(de->inum != 0 && dirhash(de->name) >= split){
+      *nde++ = *de;
+      memset(de, 0, sizeof(*de));
+    }
+  }
+  log_write(bp);
+  log_write(np);
+  brelse(bp);
+  brelse(np);
+
+  bp = bread(dp->dev, bmap(dp, 1));
+  dx = (struct dxentry*)bp->data;
+  for(j = n; j > i; j--)
+    dx[j+1] = dx[j];
+  dx[i+1].hash = split;
+  dx[i+1].block = nb;
+  dx[0].block = n + 1;
+  log_write(bp);
+  brelse(bp);
   return 0;
 }
 
@@ -552,7 +1162,8 @@ dirlookup(struct inode *dp, char *name, uint *poff)
 int
 dirlink(struct inode *dp, char *name, uint inum)
 {
-  int off;
+  int i, n, off;
+  uint bn;
   struct dirent de;
   struct inode *ip;
 
@@ -562,22 +1173,56 @@ dirlink(struct inode *dp, char *name, uint inum)
     return -1;
   }
 
-  // Look for an empty dirent.
-  for(off = 0; off < dp->size; off += sizeof(de)){
-    if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlink read");
-    if(de.inum == 0)
-      break;
+  // Index the directory when it first needs a second block.
+  if(dp->size == BSIZE && !isdot(name) && dirscan(dp, 0, 0, 0) < 0)
+    dirindex(dp);
+
+  // Look for an empty dirent: in the name's leaf, splitting
+  // the leaf if it is full, or else in the unindexed blocks.
+  off = -1;
+  bn = 0;
+  if((n = dxlookup(dp, dirhash(name), &i, &bn)) > 0){
+    while((off = dirscan(dp, bn, 0, 0)) < 0 && dirsplit(dp, i, bn, n) == 0)
+      n = dxlookup(dp, dirhash(name), &i, &bn);
+    bn = n + 2;
   }
+  if(off < 0)
+    off = dirfreeslot(dp, bn);
 
   strncpy(de.name, name, DIRSIZ);
   de.inum = inum;
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
     panic("dirlink");
+  if(off == dp->dirfree)
+    dp->dirfree = off + sizeof(de);
+  dcacheenter(dp->dev, dp->inum, name, inum);
 
   return 0;
 }
 
+// Is the directory dp empty except for "." and ".." ?
+int
+isdirempty(struct inode *dp)
+{
+  struct buf *bp;
+  struct dirent *de, *end;
+  uint bn;
+
+  for(bn = 0; bn*BSIZE < dp->size; bn++){
+    bp = bread(dp->dev, bmap(dp, bn));
+    end = (struct dirent*)(bp->data + min(BSIZE, dp->size - bn*BSIZE));
+    de = (struct dirent*)bp->data + (bn == 0 ? 2 : 0);
+    for(; de < end; de++){
+      if(de->inum != 0){
+        brelse(bp);
+        return 0;
+      }
+    }
+    brelse(bp);
+  }
+  return 1;
+}
+
 // Paths
 
 // Copy the next path element from path into name.
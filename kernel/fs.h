@@ -20,9 +20,11 @@ struct superblock {
   uint logstart;     // Block number of first log block
   uint inodestart;   // Block number of first inode block
   uint bmapstart;    // Block number of first free map block
+  uint flags;        // FS* flags below
 };
 
 #define FSMAGIC 0x10203040
+#define FSORDERED 0x1  // log only metadata; write file data in place first
 
 #define NDIRECT 12
 #define NINDIRECT (BSIZE / sizeof(uint))
@@ -58,3 +60,29 @@ struct dirent {
   char name[DIRSIZ];
 };
 
+// Directory entries per block.
+#define DPB           (BSIZE / sizeof(struct dirent))
+
+// A directory that outgrows its first block is indexed.
+// Block 0 then holds only "." and ".."; its other slots stay
+// free for good, since lookups check block 0 for dot names
+// alone.  Block 1 holds the index, and
+// each following block is a leaf of dirents whose names hash
+// (see dirhash in fs.c) into one range of values.  The index
+// starts with a header (hash DXMAGIC, block = number of leaves)
+// followed by one dxentry per leaf, sorted by hash.  Leaves
+// are blocks 2 through nleaves+1; any blocks after them are
+// overflow, searched linearly, used once the index is full.
+// A dxentry reads as a free dirent, so that code that treats
+// the directory as a plain array of dirents skips the index.
+struct dxentry {
+  ushort zero;       // always 0
+  ushort pad;
+  uint hash;         // least hash of the names in the leaf
+  uint block;        // block number of the leaf within the directory
+  uint pad2;
+};
+
+#define DXMAGIC 0x78646e69
+#define DXPB          (BSIZE / sizeof(struct dxentry))
+
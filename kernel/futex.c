@@ -0,0 +1,134 @@
+//
+// Futexes: let user programs block until a word of memory changes.
+//
+// futex_wait(addr, val) sleeps if the int at addr still holds val;
+// futex_wake(addr, n) wakes up to n processes waiting on addr.
+// Waiters are keyed on the physical address of the word, so
+// processes that share the page through a shared-memory segment
+// (or an address space) find each other.  Each waiter sits on
+// the list of one of NFUTEXHASH buckets.  The bucket lock
+// serializes futex_wait's check of the value against
+// futex_wake, so a wake issued after the word was changed
+// cannot be missed.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+#define NFUTEXHASH 61
+
+// lives on the waiting process's kernel stack.
+struct futexwaiter {
+  uint64 pa;                 // physical address of the word
+  int woken;
+  struct futexwaiter *next;
+};
+
+struct {
+  struct spinlock lock;
+  struct futexwaiter *head;
+} futexhash[NFUTEXHASH];
+
+void
+futexinit(void)
+{
+  for(int i = 0; i < NFUTEXHASH; i++)
+    initlock(&futexhash[i].lock, "futex");
+}
+
+// Translate the user address of a futex word to a physical
+// address, or 0 if it is misaligned or not mapped.  The caller
+// holds vm_lock, so that a thread sharing the address space
+// can't unmap and free the page while the word is in use.
+static uint64
+futexaddr(uint64 addr)
+{
+  uint64 pa;
+
+  if(addr % sizeof(int) != 0)
+    return 0;
+  if((pa = walkaddr(myproc()->pagetable, PGROUNDDOWN(addr))) == 0)
+    return 0;
+  return pa + (addr - PGROUNDDOWN(addr));
+}
+
+// Sleep until woken by futex_wake(), provided the int at
+// addr still holds val.  Returns 0 if woken, -1 if the value
+// had already changed, addr is bad, or the process is killed.
+int
+futex_wait(uint64 addr, int val)
+{
+  struct futexwaiter w, **pp;
+  uint64 pa;
+  int h;
+
+  acquire(&vm_lock);
+  if((pa = futexaddr(addr)) == 0){
+    release(&vm_lock);
+    return -1;
+  }
+  h = (pa / sizeof(int)) % NFUTEXHASH;
+
+  acquire(&futexhash[h].lock);
+  __sync_synchronize();
+  if(*(volatile int*)pa != val){
+    release(&futexhash[h].lock);
+    release(&vm_lock);
+    return -1;
+  }
+  // once on the list, the waiter only uses pa as a key.
+  release(&vm_lock);
+  // append, so that futex_wake() wakes waiters in FIFO order.
+  w.pa = pa;
+  w.woken = 0;
+  w.next = 0;
+  for(pp = &futexhash[h].head; *pp; pp = &(*pp)->next)
+    ;
+  *pp = &w;
+
+  while(!w.woken && !myproc()->killed)
+    sleep(&w, &futexhash[h].lock);
+
+  for(pp = &futexhash[h].head; *pp; pp = &(*pp)->next){
+    if(*pp == &w){
+      *pp = w.next;
+      break;
+    }
+  }
+  release(&futexhash[h].lock);
+  return w.woken ? 0 : -1;
+}
+
+// Wake up to n processes waiting on the int at addr.
+// Returns the number woken, or -1 if addr is bad.
+int
+futex_wake(uint64 addr, int n)
+{
+  struct futexwaiter *w;
+  uint64 pa;
+  int h, nwoken;
+
+  acquire(&vm_lock);
+  pa = futexaddr(addr);
+  release(&vm_lock);
+  if(pa == 0)
+    return -1;
+  h = (pa / sizeof(int)) % NFUTEXHASH;
+
+  nwoken = 0;
+  acquire(&futexhash[h].lock);
+  for(w = futexhash[h].head; w && nwoken < n; w = w->next){
+    if(w->pa == pa && !w->woken){
+      w->woken = 1;
+      wakeup(w);
+      nwoken++;
+    }
+  }
+  release(&futexhash[h].lock);
+  return nwoken;
+}
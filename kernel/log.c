@@ -6,6 +6,7 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "trace.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
@@ -17,37 +18,90 @@
 //
 // A system call should call begin_op()/end_op() to mark
 // its start and end. Usually begin_op() just increments
-// the count of in-progress FS system calls and returns.
+// the count of in-progress FS system calls and reserves
+// MAXOPBLOCKS blocks of log space for it.
 // But if it thinks the log is close to running out, it
 // sleeps until the last outstanding end_op() commits.
+// An operation that writes more blocks, such as a large
+// file write, reserves its own amount with begin_opn().
 //
 // The log is a physical re-do log containing disk blocks.
-// The on-disk log format:
+// It occupies sb.nlog blocks.  The first is the tail block,
+// which says where recovery should start; the rest are a
+// circular area to which each commit appends a transaction:
 //   header block, containing block #s for block A, B, C, ...
+//     and a checksum of the header and blocks
 //   block A
 //   block B
 //   block C
 //   ...
+// Each header carries a sequence number one greater than the
+// previous transaction's.  A transaction is committed once its
+// header is on disk; recovery replays the transactions it finds
+// by following the sequence from the tail, and stops at the
+// first header that is stale (wrong sequence number) or whose
+// checksum doesn't match, i.e. one whose writes didn't all
+// complete.  So unlike a log with a single header, a commit
+// needs no second header write to erase the transaction.
+// commit() installs each transaction as soon as it is in the
+// log; the tail moves, with one extra write, only when the log
+// wraps around to its start, or as described below.
 // Log appends are synchronous.
+//
+// On a file system with FSORDERED set in the superblock
+// (the default from mkfs), writei() writes file data blocks
+// straight to their home locations, before the transaction
+// that makes them part of the file commits, and only metadata
+// goes through the log.  So that a crash can't leave a file
+// whose deletion didn't commit pointing at another file's
+// data, blocks freed by a transaction aren't reused until it
+// commits (see bcommit() in fs.c).  And since a freed block
+// may then be rewritten in place, commit() moves the tail past
+// a transaction that freed blocks, so that recovery never
+// replays an older logged copy of such a block on top of it.
+
+#define LOGMAGIC 0x6c6f6721
+#define RBATCH 8    // log blocks read or written by recovery at once
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
 struct logheader {
+  uint magic;
+  uint seq;
+  uint sum;        // checksum of the header and the logged blocks
   int n;
   int block[LOGSIZE];
 };
 
+// Contents of the tail block.
+struct logtail {
+  uint magic;
+  uint start;      // log offset of the oldest header recovery should read
+  uint seq;        // its sequence number
+};
+
 struct log {
   struct spinlock lock;
   int start;
   int size;
+  int max;         // most blocks in one transaction
+  int head;        // log offset at which the next transaction goes
+  uint seq;        // sequence number of the next transaction
   int outstanding; // how many FS sys calls are executing.
+  int reserved;    // log blocks reserved by outstanding calls.
   int committing;  // in commit(), please wait.
   int dev;
+  int ordered;     // file data bypasses the log
   struct logheader lh;
 };
 struct log log[NDISK];
 
+// One block to be installed by recovery.
+struct rentry {
+  uint blockno;    // home location; 0 if the entry is unused
+  uint pos;        // log offset of the latest copy
+};
+
 static void recover_from_log(int);
 static void commit(int);
 
@@ -56,99 +110,288 @@ initlog(int dev, struct superblock *sb)
 {
   if (sizeof(struct logheader) >= BSIZE)
     panic("initlog: too big logheader");
+  if (sb->nlog < MAXOPBLOCKS + 3)
+    panic("initlog: log too small");
 
   initlock(&log[dev].lock, "log");
   log[dev].start = sb->logstart;
   log[dev].size = sb->nlog;
+  // a transaction must fit in the log after the tail block
+  // and its header, and in one header.  its blocks stay pinned
+  // in the buffer cache until installed, so it must also leave
+  // the cache room for the blocks operations read meanwhile.
+  log[dev].max = sb->nlog - 2;
+  if (log[dev].max > LOGSIZE)
+    log[dev].max = LOGSIZE;
+  if (log[dev].max > NBUF - MAXOPBLOCKS)
+    log[dev].max = NBUF - MAXOPBLOCKS;
   log[dev].dev = dev;
+  log[dev].ordered = (sb->flags & FSORDERED) != 0;
   recover_from_log(dev);
 }
 
-// Copy committed blocks from log to their home location
+// Add a block to a running checksum.
+static uint
+logsum(uint sum, uchar *data)
+{
+  uint *w = (uint*)data;
+
+  for(int i = 0; i < BSIZE/sizeof(uint); i++)
+    sum = ((sum << 5) | (sum >> 27)) ^ w[i];
+  return sum;
+}
+
+// Checksum of the header fields other than sum.
+static uint
+headsum(struct logheader *lh)
+{
+  uint sum = lh->magic ^ lh->seq ^ lh->n;
+
+  for(int i = 0; i < lh->n; i++)
+    sum = ((sum << 5) | (sum >> 27)) ^ lh->block[i];
+  return sum;
+}
+
+// Copy committed blocks of the transaction just written
+// at log offset pos from log to their home location.
 static void
-install_trans(int dev)
+install_trans(int dev, int pos)
 {
   int tail;
 
   for (tail = 0; tail < log[dev].lh.n; tail++) {
-    struct buf *lbuf = bread(dev, log[dev].start+tail+1); // read log block
+    struct buf *lbuf = bread(dev, log[dev].start+pos+tail+1); // read log block
     struct buf *dbuf = bread(dev, log[dev].lh.block[tail]); // read dst
     memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
     bwrite(dbuf);  // write dst to disk
+    dbuf->logged = 0;
     bunpin(dbuf);
     brelse(lbuf);
     brelse(dbuf);
   }
 }
 
-// Read the log header from disk into the in-memory log header
-static void
-read_head(int dev)
+// Read the header at log offset pos into the in-memory log
+// header, and check that it and its blocks form the committed
+// transaction numbered seq.  Returns 1 if so, else 0.
+static int
+read_head(int dev, int pos, uint seq)
 {
-  struct buf *buf = bread(dev, log[dev].start);
+  struct buf *buf = bread(dev, log[dev].start+pos);
   struct logheader *lh = (struct logheader *) (buf->data);
-  int i;
-  log[dev].lh.n = lh->n;
-  for (i = 0; i < log[dev].lh.n; i++) {
-    log[dev].lh.block[i] = lh->block[i];
+  struct buf *bufs[RBATCH];
+  uint sum, bn[RBATCH];
+  int i, j, k;
+
+  log[dev].lh.n = 0;
+  if (lh->magic != LOGMAGIC || lh->seq != seq || lh->n <= 0 ||
+      lh->n > log[dev].max || pos + 1 + lh->n > log[dev].size) {
+    brelse(buf);
+    return 0;
   }
+  log[dev].lh = *lh;
   brelse(buf);
+
+  sum = headsum(&log[dev].lh);
+  for (i = 0; i < log[dev].lh.n; i += k) {
+    k = log[dev].lh.n - i < RBATCH ? log[dev].lh.n - i : RBATCH;
+    for (j = 0; j < k; j++)
+      bn[j] = log[dev].start+pos+1+i+j;
+    breadv(dev, bn, k, bufs);
+    for (j = 0; j < k; j++) {
+      sum = logsum(sum, bufs[j]->data);
+      brelse(bufs[j]);
+    }
+  }
+  if (sum != log[dev].lh.sum) {
+    log[dev].lh.n = 0;
+    return 0;
+  }
+  return 1;
 }
 
-// Write in-memory log header to disk.
+// Write in-memory log header, with checksum sum of the
+// logged blocks, to disk at log[dev].head.
 // This is the true point at which the
 // current transaction commits.
 static void
-write_head(int dev)
+write_head(int dev, uint sum)
 {
-  struct buf *buf = bread(dev, log[dev].start);
+  struct buf *buf = bread(dev, log[dev].start+log[dev].head);
   struct logheader *hb = (struct logheader *) (buf->data);
   int i;
+  hb->magic = LOGMAGIC;
+  hb->seq = log[dev].seq;
   hb->n = log[dev].lh.n;
   for (i = 0; i < log[dev].lh.n; i++) {
     hb->block[i] = log[dev].lh.block[i];
   }
+  hb->sum = sum;
+  bwrite(buf);
+  brelse(buf);
+}
+
+// Tell recovery to start at the next transaction to be committed.
+static void
+write_tail(int dev)
+{
+  struct buf *buf = bread(dev, log[dev].start);
+  struct logtail *lt = (struct logtail *) (buf->data);
+  lt->magic = LOGMAGIC;
+  lt->start = log[dev].head;
+  lt->seq = log[dev].seq;
   bwrite(buf);
   brelse(buf);
 }
 
+// Note that the latest logged copy of block blockno is at
+// log offset pos, in recovery's open-addressed table.
+static void
+recover_note(struct rentry *tab, int ntab, uint blockno, uint pos)
+{
+  int h = (blockno * 2654435761U) & (ntab - 1);
+
+  while (tab[h].blockno != 0 && tab[h].blockno != blockno)
+    h = (h + 1) & (ntab - 1);
+  tab[h].blockno = blockno;
+  tab[h].pos = pos;
+}
+
+// Copy the blocks noted in tab from the log to their home
+// locations, RBATCH at a time: all of a batch's log reads are
+// issued together, then all of its home writes.
+// Returns the number of blocks copied.
+static int
+recover_install(int dev, struct rentry *tab, int ntab)
+{
+  struct buf *lbuf[RBATCH], *dbuf[RBATCH];
+  uint bn[RBATCH], home[RBATCH];
+  int i, j, k, n;
+
+  n = 0;
+  for (i = 0; i < ntab; ) {
+    for (k = 0; i < ntab && k < RBATCH; i++) {
+      if (tab[i].blockno != 0) {
+        bn[k] = log[dev].start + tab[i].pos;
+        home[k++] = tab[i].blockno;
+      }
+    }
+    if (k == 0)
+      break;
+    breadv(dev, bn, k, lbuf);
+    for (j = 0; j < k; j++) {
+      dbuf[j] = bnew(dev, home[j]);
+      memmove(dbuf[j]->data, lbuf[j]->data, BSIZE);
+      brelse(lbuf[j]);
+    }
+    bwritev(dbuf, k);
+    for (j = 0; j < k; j++)
+      brelse(dbuf[j]);
+    n += k;
+  }
+  return n;
+}
+
+// Find the committed transactions, following the sequence from
+// the tail, then install them.  Only the latest copy of a block
+// that several transactions logged is installed.  Nothing says
+// they are installed until write_tail(), so a crash during
+// recovery just means doing it again.
 static void
 recover_from_log(int dev)
 {
-  read_head(dev);
-  install_trans(dev); // if committed, copy from log to disk
+  struct buf *buf = bread(dev, log[dev].start);
+  struct logtail *lt = (struct logtail *) (buf->data);
+  struct rentry *tab;
+  int i, ntab, ntrans, nlogged, ninstalled;
+  uint t0;
+
+  acquire(&tickslock);
+  t0 = ticks;
+  release(&tickslock);
+
+  if (lt->magic == LOGMAGIC && lt->start >= 1 && lt->start < log[dev].size) {
+    log[dev].head = lt->start;
+    log[dev].seq = lt->seq;
+  } else {
+    // a fresh log.
+    log[dev].head = 1;
+    log[dev].seq = 1;
+  }
+  brelse(buf);
+
+  // room for every block in the log, at most half full.
+  for (ntab = 1; ntab < 2*log[dev].size; ntab *= 2)
+    ;
+  if ((tab = bd_malloc(ntab * sizeof(struct rentry))) == 0)
+    panic("recover_from_log: no memory");
+  memset(tab, 0, ntab * sizeof(struct rentry));
+
+  ntrans = nlogged = 0;
+  while (read_head(dev, log[dev].head, log[dev].seq)) {
+    for (i = 0; i < log[dev].lh.n; i++)
+      recover_note(tab, ntab, log[dev].lh.block[i], log[dev].head + 1 + i);
+    ntrans++;
+    nlogged += log[dev].lh.n;
+    log[dev].head += 1 + log[dev].lh.n;
+    log[dev].seq++;
+  }
   log[dev].lh.n = 0;
-  write_head(dev); // clear the log
+  ninstalled = recover_install(dev, tab, ntab);
+  bd_free(tab);
+  write_tail(dev); // everything before head is installed
+
+  if (ntrans > 0) {
+    acquire(&tickslock);
+    t0 = ticks - t0;
+    release(&tickslock);
+    printf("log: dev %d: replayed %d blocks (%d superseded) from %d transactions in %d ticks\n",
+           dev, ninstalled, nlogged - ninstalled, ntrans, t0);
+  }
 }
 
-// called at the start of each FS system call.
+// called at the start of an FS system call that
+// will write at most n blocks.
 void
-begin_op(int dev)
+begin_opn(int dev, int n)
 {
+  if(n > log[dev].max)
+    panic("begin_opn: too big");
   acquire(&log[dev].lock);
   while(1){
     if(log[dev].committing){
       sleep(&log, &log[dev].lock);
-    } else if(log[dev].lh.n + (log[dev].outstanding+1)*MAXOPBLOCKS > LOGSIZE){
+    } else if(log[dev].lh.n + log[dev].reserved + n > log[dev].max){
       // this op might exhaust log space; wait for commit.
       sleep(&log, &log[dev].lock);
     } else {
       log[dev].outstanding += 1;
+      log[dev].reserved += n;
+      trace(TR_BEGINOP, dev, n, 0);
       release(&log[dev].lock);
       break;
     }
   }
 }
 
-// called at the end of each FS system call.
+// called at the start of each FS system call.
+void
+begin_op(int dev)
+{
+  begin_opn(dev, MAXOPBLOCKS);
+}
+
+// called at the end of each FS system call started with begin_opn(dev, n).
 // commits if this was the last outstanding operation.
 void
-end_op(int dev)
+end_opn(int dev, int n)
 {
   int do_commit = 0;
 
   acquire(&log[dev].lock);
   log[dev].outstanding -= 1;
+  log[dev].reserved -= n;
+  trace(TR_ENDOP, dev, log[dev].outstanding, 0);
   if(log[dev].committing)
     panic("log[dev].committing");
   if(log[dev].outstanding == 0){
@@ -173,36 +416,106 @@ end_op(int dev)
   }
 }
 
-// Copy modified blocks from cache to log.
-static void
+// called at the end of each FS system call.
+void
+end_op(int dev)
+{
+  end_opn(dev, MAXOPBLOCKS);
+}
+
+// Copy modified blocks from cache to the log after the header
+// at log[dev].head.  Returns the transaction's checksum.
+static uint
 write_log(int dev)
 {
   int tail;
+  uint sum;
 
+  log[dev].lh.magic = LOGMAGIC;
+  log[dev].lh.seq = log[dev].seq;
+  sum = headsum(&log[dev].lh);
   for (tail = 0; tail < log[dev].lh.n; tail++) {
-    struct buf *to = bread(dev, log[dev].start+tail+1); // log block
+    struct buf *to = bread(dev, log[dev].start+log[dev].head+tail+1); // log block
     struct buf *from = bread(dev, log[dev].lh.block[tail]); // cache block
     memmove(to->data, from->data, BSIZE);
+    sum = logsum(sum, to->data);
     bwrite(to);  // write the log
     brelse(from);
     brelse(to);
   }
+  return sum;
+}
+
+// Make room for the current transaction at log[dev].head,
+// going back to the start of the log if it doesn't fit
+// before the end.  Everything already in the log has been
+// installed, so it can be overwritten.
+static void
+log_reserve(int dev)
+{
+  if (log[dev].head + 1 + log[dev].lh.n > log[dev].size) {
+    log[dev].head = 1;
+    write_tail(dev);
+  }
 }
 
 static void
 commit(int dev)
 {
+  int freed;
+
   if (log[dev].lh.n > 0) {
-    write_log(dev);     // Write modified blocks from cache to log
-    write_head(dev);    // Write header to disk -- the real commit
-    install_trans(dev); // Now install writes to home locations
+    trace(TR_COMMIT, dev, log[dev].lh.n, 0);
+    log_reserve(dev);
+    write_head(dev, write_log(dev)); // Write blocks, then header -- the real commit
+    trace(TR_COMMITLOGGED, dev, log[dev].seq, 0);
+    freed = bcommit(dev);     // Blocks the transaction freed are now free
+    install_trans(dev, log[dev].head); // Now install writes to home locations
+    trace(TR_COMMITDONE, dev, log[dev].seq, 0);
+    log[dev].head += 1 + log[dev].lh.n;
+    log[dev].seq++;
     log[dev].lh.n = 0;
-    write_head(dev);    // Erase the transaction from the log
+    if (freed && log[dev].ordered)
+      write_tail(dev);        // Don't replay over reused blocks
   }
 }
 
+// Wait until everything that FS system calls on dev have
+// written so far is committed.  Since the last end_op() of
+// a transaction commits it, that's only a matter of waiting
+// for the operations still outstanding, if any of them
+// have written anything.
+void
+log_force(int dev)
+{
+  uint seq;
+
+  acquire(&log[dev].lock);
+  seq = log[dev].seq;
+  while((log[dev].lh.n > 0 || log[dev].committing) && log[dev].seq == seq)
+    sleep(&log, &log[dev].lock);
+  release(&log[dev].lock);
+}
+
+// The most blocks one transaction on dev can hold, for
+// callers of begin_opn() that size their own operations.
+int
+log_max(int dev)
+{
+  return log[dev].max;
+}
+
+// Does file data on dev bypass the log?
+int
+log_ordered(int dev)
+{
+  return log[dev].ordered;
+}
+
 // Caller has modified b->data and is done with the buffer.
 // Record the block number and pin in the cache by increasing refcnt.
+// Since a logged buf stays pinned until commit() installs it,
+// b->logged says whether it is already in the transaction.
 // commit()/write_log() will do the disk write.
 //
 // log_write() replaces bwrite(); a typical use is:
@@ -213,23 +526,17 @@ commit(int dev)
 void
 log_write(struct buf *b)
 {
-  int i;
-
   int dev = b->dev;
-  if (log[dev].lh.n >= LOGSIZE || log[dev].lh.n >= log[dev].size - 1)
+  if (log[dev].lh.n >= log[dev].max)
     panic("too big a transaction");
   if (log[dev].outstanding < 1)
     panic("log_write outside of trans");
 
   acquire(&log[dev].lock);
-  for (i = 0; i < log[dev].lh.n; i++) {
-    if (log[dev].lh.block[i] == b->blockno)   // log absorbtion
-      break;
-  }
-  log[dev].lh.block[i] = b->blockno;
-  if (i == log[dev].lh.n) {  // Add new block to log?
+  if (!b->logged) {  // Add new block to log? (else log absorbtion)
+    log[dev].lh.block[log[dev].lh.n++] = b->blockno;
+    b->logged = 1;
     bpin(b);
-    log[dev].lh.n++;
   }
   release(&log[dev].lock);
 }
@@ -247,6 +554,7 @@ crash_op(int dev, int docommit)
   if(log[dev].outstanding == 0)
     panic("end_op: already closed");
   log[dev].outstanding -= 1;
+  log[dev].reserved -= MAXOPBLOCKS;
   if(log[dev].committing)
     panic("log[dev].committing");
   if(log[dev].outstanding == 0){
@@ -262,8 +570,8 @@ crash_op(int dev, int docommit)
     // to sleep with locks.
 
     if (log[dev].lh.n > 0) {
-      write_log(dev);     // Write modified blocks from cache to log
-      write_head(dev);    // Write header to disk -- the real commit
+      log_reserve(dev);
+      write_head(dev, write_log(dev)); // Write blocks, then header -- the real commit
     }
   }
   panic("crashed file system; please restart xv6 and run crashtest\n");
@@ -30,7 +30,12 @@ main()
     plicinithart();  // ask PLIC for device interrupts
     binit();         // buffer cache
     iinit();         // inode cache
+    dcacheinit();    // directory name-lookup cache
     fileinit();      // file table
+    shminit();       // shared-memory segments
+    futexinit();     // futex wait queues
+    profinit();      // sampling profiler
+    traceinit();     // event tracing
     virtio_disk_init(minor(ROOTDEV)); // emulated hard disk
     userinit();      // first user process
     __sync_synchronize();
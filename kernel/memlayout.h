@@ -62,7 +62,20 @@
 //   original data and bss
 //   fixed-size stack
 //   expandable heap
+//   ...  (text through heap must stay below SHMBASE)
+//   shared-memory segment slots, up to PLIC
 //   ...
 //   TRAPFRAME (p->tf, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+
+// threads made by clone() share a page table, so each maps
+// its trapframe at its own address beneath TRAPFRAME.
+#define THREADTRAPFRAME(p) (TRAPFRAME - ((p)+1)*PGSIZE)
+
+// shared-memory segments (shm.c) are attached in NSHMPROC
+// fixed slots of SHMMAXPAGES pages each, ending at PLIC.
+// everything below SHMBASE is also mirrored into the
+// process's kernel page table.
+#define SHMBASE (PLIC - NSHMPROC*SHMMAXPAGES*PGSIZE)
+#define SHMSLOT(i) (SHMBASE + (i)*SHMMAXPAGES*PGSIZE)
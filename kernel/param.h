@@ -2,13 +2,21 @@
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NDCACHE     128  // size of directory name-lookup cache
+#define NINODE       50  // initial number of in-memory i-nodes
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       0  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
+#define TICKCYCLES 1000000 // time-CSR cycles per clock tick; about 1/10th second in qemu
+#define NSYSCALL     43  // system call numbers are below this
+#define NSYSHIST     16  // buckets in a system call latency histogram
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
+#define LOGSIZE      (MAXOPBLOCKS*24) // max data blocks a log header can name
+#define NBUF         (MAXOPBLOCKS*12) // size of disk block cache
 #define FSSIZE       2000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
+#define KLOGSIZE     16384 // bytes of kernel messages kept for dmesg()
 #define NDISK        2
+#define NSHM         16  // maximum number of shared-memory segments
+#define NSHMPROC      8  // shared-memory segments attached per process
+#define SHMMAXPAGES  64  // maximum pages in a shared-memory segment
@@ -8,11 +8,28 @@
 #include "sleeplock.h"
 #include "file.h"
 
-#define PIPESIZE 512
+// A pipe buffers data in a ring of up to PIPEBUFS pages, which
+// are allocated as the writer needs them and freed (but for one
+// spare) as the reader drains them.  Data moves between user
+// memory and the pages in page-sized chunks.  A page-aligned
+// read of a whole page takes the page itself: it is mapped into
+// the reader in place of the reader's own page, which then goes
+// back to the pipe.  sendfile() and splice() can also hand the
+// pipe a page they have filled, with pipeputpage().
+#define PIPEBUFS 16
+
+struct pipebuf {
+  char *page;
+  uint off;       // first unread byte in page
+  uint len;       // bytes of data starting at off
+};
 
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
+  struct pipebuf bufs[PIPEBUFS];
+  uint head;      // bufs[head % PIPEBUFS] is the oldest
+  uint nbufs;     // number of bufs in use
+  char *spare;    // an empty page kept for the next write
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
@@ -34,6 +51,9 @@ pipealloc(struct file **f0, struct file **f1)
   pi->writeopen = 1;
   pi->nwrite = 0;
   pi->nread = 0;
+  pi->head = 0;
+  pi->nbufs = 0;
+  pi->spare = 0;
   initlock(&pi->lock, "pipe");
   (*f0)->type = FD_PIPE;
   (*f0)->readable = 1;
@@ -55,6 +75,17 @@ pipealloc(struct file **f0, struct file **f1)
   return -1;
 }
 
+// Free the pages of a pipe that nobody has open.
+static void
+pipefree(struct pipe *pi)
+{
+  for(; pi->nbufs > 0; pi->nbufs--, pi->head++)
+    kfree(pi->bufs[pi->head % PIPEBUFS].page);
+  if(pi->spare)
+    kfree(pi->spare);
+  kfree((char*)pi);
+}
+
 void
 pipeclose(struct pipe *pi, int writable)
 {
@@ -68,58 +99,167 @@ pipeclose(struct pipe *pi, int writable)
   }
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
-    kfree((char*)pi);
+    pipefree(pi);
   } else
     release(&pi->lock);
 }
 
+// Return the newest buffer if it has room, else start a new one.
+// Returns 0 if the pipe is full.
+// Caller must hold pi->lock.
+static struct pipebuf*
+pipewbuf(struct pipe *pi)
+{
+  struct pipebuf *b;
+  char *page;
+
+  if(pi->nbufs > 0){
+    b = &pi->bufs[(pi->head + pi->nbufs - 1) % PIPEBUFS];
+    if(b->off + b->len < PGSIZE)
+      return b;
+  }
+  if(pi->nbufs == PIPEBUFS)
+    return 0;
+  if((page = pi->spare) != 0)
+    pi->spare = 0;
+  else if((page = kalloc()) == 0)
+    return 0;
+  b = &pi->bufs[(pi->head + pi->nbufs) % PIPEBUFS];
+  b->page = page;
+  b->off = 0;
+  b->len = 0;
+  pi->nbufs++;
+  return b;
+}
+
+// Retire the oldest buffer, which the reader has emptied.
+// Caller must hold pi->lock.
+static void
+pipepop(struct pipe *pi)
+{
+  struct pipebuf *b = &pi->bufs[pi->head % PIPEBUFS];
+
+  if(pi->spare == 0)
+    pi->spare = b->page;
+  else
+    kfree(b->page);
+  pi->head++;
+  pi->nbufs--;
+}
+
+// Write n bytes from addr to the pipe.  If user_src==1,
+// then addr is a user virtual address; otherwise, addr is
+// a kernel address.
 int
-pipewrite(struct pipe *pi, uint64 addr, int n)
+pipewrite(struct pipe *pi, int user_src, uint64 addr, int n)
 {
-  int i;
-  char ch;
+  int i, m;
+  struct pipebuf *b;
   struct proc *pr = myproc();
 
   acquire(&pi->lock);
-  for(i = 0; i < n; i++){
-    while(pi->nwrite == pi->nread + PIPESIZE){  //DOC: pipewrite-full
-      if(pi->readopen == 0 || myproc()->killed){
-        release(&pi->lock);
-        return -1;
+  for(i = 0; i < n; i += m){
+    if(pi->readopen == 0 || pr->killed){
+      release(&pi->lock);
+      return -1;
+    }
+    if((b = pipewbuf(pi)) == 0){  //DOC: pipewrite-full
+      if(pi->nbufs == 0){
+        // out of memory, not full.  a short count is fine, but
+        // 0 would look like success to a caller that loops.
+        if(i == 0){
+          release(&pi->lock);
+          return -1;
+        }
+        break;
       }
       wakeup(&pi->nread);
       sleep(&pi->nwrite, &pi->lock);
+      m = 0;
+      continue;
     }
-    if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
+    m = PGSIZE - (b->off + b->len);
+    if(m > n - i)
+      m = n - i;
+    if(either_copyin(b->page + b->off + b->len, user_src, addr + i, m) == -1)
       break;
-    pi->data[pi->nwrite++ % PIPESIZE] = ch;
+    b->len += m;
+    pi->nwrite += m;
   }
   wakeup(&pi->nread);
   release(&pi->lock);
-  return n;
+  return i;
+}
+
+// Append the n bytes at the start of page, a page from
+// kalloc(), to the pipe without copying them: the pipe
+// takes the page.  Returns 0, or -1 if there are no
+// readers, in which case the caller still owns page.
+int
+pipeputpage(struct pipe *pi, char *page, int n)
+{
+  struct pipebuf *b;
+  struct proc *pr = myproc();
+
+  acquire(&pi->lock);
+  while(pi->nbufs == PIPEBUFS){
+    if(pi->readopen == 0 || pr->killed)
+      break;
+    wakeup(&pi->nread);
+    sleep(&pi->nwrite, &pi->lock);
+  }
+  if(pi->readopen == 0 || pr->killed){
+    release(&pi->lock);
+    return -1;
+  }
+  b = &pi->bufs[(pi->head + pi->nbufs) % PIPEBUFS];
+  b->page = page;
+  b->off = 0;
+  b->len = n;
+  pi->nbufs++;
+  pi->nwrite += n;
+  wakeup(&pi->nread);
+  release(&pi->lock);
+  return 0;
 }
 
+// Read up to n bytes from the pipe to addr.  If user_dst==1,
+// then addr is a user virtual address; otherwise, addr is
+// a kernel address.
 int
-piperead(struct pipe *pi, uint64 addr, int n)
+piperead(struct pipe *pi, int user_dst, uint64 addr, int n)
 {
-  int i;
+  int i, m;
+  struct pipebuf *b;
   struct proc *pr = myproc();
-  char ch;
+  uint64 old;
 
   acquire(&pi->lock);
-  while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
-    if(myproc()->killed){
+  while(pi->nbufs == 0 && pi->writeopen){  //DOC: pipe-empty
+    if(pr->killed){
       release(&pi->lock);
       return -1;
     }
     sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(pi->nread == pi->nwrite)
-      break;
-    ch = pi->data[pi->nread++ % PIPESIZE];
-    if(copyout(pr->pagetable, addr + i, &ch, 1) == -1)
+  for(i = 0; i < n && pi->nbufs > 0; i += m){  //DOC: piperead-copy
+    b = &pi->bufs[pi->head % PIPEBUFS];
+    m = b->len;
+    if(m > n - i)
+      m = n - i;
+    if(user_dst && m == PGSIZE && (addr + i) % PGSIZE == 0 && addr + i + PGSIZE <= pr->sz &&
+       !vmshared(pr) &&
+       (old = uvmswap(pr->pagetable, pr->kpagetable, addr + i, (uint64)b->page)) != 0){
+      // the reader now owns the pipe's page; give the pipe its old one.
+      b->page = (char*)old;
+    } else if(either_copyout(user_dst, addr + i, b->page + b->off, m) == -1){
       break;
+    }
+    b->off += m;
+    b->len -= m;
+    pi->nread += m;
+    if(b->len == 0)
+      pipepop(pi);
   }
   wakeup(&pi->nwrite);  //DOC: piperead-wakeup
   release(&pi->lock);
@@ -1,6 +1,15 @@
 //
 // formatted console output -- printf, panic.
 //
+// printf() formats into a buffer on the caller's stack and
+// appends it to the kernel log, a ring holding the last
+// KLOGSIZE bytes printed, taking klog.lock just long enough
+// to copy it in.  The uart sends the log to the console from
+// its transmit interrupt (see uartstart()), so printing never
+// waits for the serial port.  dmesg() reads the log back.
+// panic() prints synchronously, after first putting out what
+// the console hadn't shown yet.
+//
 
 #include <stdarg.h>
 
@@ -17,16 +26,117 @@
 
 volatile int panicked = 0;
 
-// lock to avoid interleaving concurrent printf's.
 static struct {
   struct spinlock lock;
-  int locking;
-} pr;
+  char buf[KLOGSIZE];
+  uint w;       // bytes ever logged; next goes in buf[w % KLOGSIZE]
+  uint c;       // bytes the console has been given
+  int sync;     // panicking: print straight to the console
+} klog;
+
+// one printf()'s output, collected before it goes in the log,
+// so that messages from different CPUs don't interleave.
+struct pbuf {
+  char buf[128];
+  int n;
+};
 
 static char digits[] = "0123456789abcdef";
 
+// Append n bytes to the log, and start the uart on them
+// if it is idle.
 static void
-printint(int xx, int base, int sign)
+klogwrite(char *s, int n)
+{
+  int i, nolocks;
+
+  if(klog.sync){
+    for(i = 0; i < n; i++)
+      consputc(s[i]);
+    return;
+  }
+
+  acquire(&klog.lock);
+  for(i = 0; i < n; i++)
+    klog.buf[klog.w++ % KLOGSIZE] = s[i];
+  if(klog.w - klog.c > KLOGSIZE)
+    klog.c = klog.w - KLOGSIZE;  // the console fell a whole log behind
+  release(&klog.lock);
+
+  // the uart holds its lock while it calls wakeup(), which
+  // takes each p->lock, so kick it only if this CPU holds no
+  // locks.  otherwise the next uart interrupt or clock tick
+  // will send the message.
+  push_off();
+  nolocks = mycpu()->noff == 1;
+  pop_off();
+  if(nolocks)
+    uartkick();
+}
+
+// Take up to n bytes of the log that the console hasn't
+// shown yet, for uartstart().  Returns how many it took.
+int
+klogconsole(char *dst, int n)
+{
+  int i;
+
+  acquire(&klog.lock);
+  for(i = 0; i < n && klog.c != klog.w; i++)
+    dst[i] = klog.buf[klog.c++ % KLOGSIZE];
+  release(&klog.lock);
+  return i;
+}
+
+// Copy the last n bytes of the log, or all of it if it holds
+// less, to user address dst.  The bytes go through a small
+// buffer, a piece at a time, so that klog.lock isn't held
+// across copyout(), which may sleep and which would keep every
+// printf() waiting.  If printing overwrites bytes before they
+// are copied, stops short.  Returns the number of bytes
+// copied, or -1.
+int
+klogread(uint64 dst, int n)
+{
+  struct proc *p = myproc();
+  char buf[128];
+  uint start, m, i, j, k;
+
+  acquire(&klog.lock);
+  m = klog.w < KLOGSIZE ? klog.w : KLOGSIZE;
+  if(n < m)
+    m = n;
+  start = klog.w - m;
+  release(&klog.lock);
+
+  for(i = 0; i < m; i += k){
+    k = m - i < sizeof(buf) ? m - i : sizeof(buf);
+    acquire(&klog.lock);
+    if(klog.w - (start + i) > KLOGSIZE){
+      release(&klog.lock);
+      break;
+    }
+    for(j = 0; j < k; j++)
+      buf[j] = klog.buf[(start + i + j) % KLOGSIZE];
+    release(&klog.lock);
+    if(copyout(p->pagetable, dst + i, buf, k) < 0)
+      return -1;
+  }
+  return i;
+}
+
+static void
+putc(struct pbuf *pb, int c)
+{
+  if(pb->n == sizeof(pb->buf)){
+    klogwrite(pb->buf, pb->n);
+    pb->n = 0;
+  }
+  pb->buf[pb->n++] = c;
+}
+
+static void
+printint(struct pbuf *pb, int xx, int base, int sign)
 {
   char buf[16];
   int i;
@@ -46,38 +156,36 @@ printint(int xx, int base, int sign)
     buf[i++] = '-';
 
   while(--i >= 0)
-    consputc(buf[i]);
+    putc(pb, buf[i]);
 }
 
 static void
-printptr(uint64 x)
+printptr(struct pbuf *pb, uint64 x)
 {
   int i;
-  consputc('0');
-  consputc('x');
+  putc(pb, '0');
+  putc(pb, 'x');
   for (i = 0; i < (sizeof(uint64) * 2); i++, x <<= 4)
-    consputc(digits[x >> (sizeof(uint64) * 8 - 4)]);
+    putc(pb, digits[x >> (sizeof(uint64) * 8 - 4)]);
 }
 
 // Print to the console. only understands %d, %x, %p, %s.
 void
 printf(char *fmt, ...)
 {
+  struct pbuf pb;
   va_list ap;
-  int i, c, locking;
+  int i, c;
   char *s;
 
-  locking = pr.locking;
-  if(locking)
-    acquire(&pr.lock);
-
   if (fmt == 0)
     panic("null fmt");
 
+  pb.n = 0;
   va_start(ap, fmt);
   for(i = 0; (c = fmt[i] & 0xff) != 0; i++){
     if(c != '%'){
-      consputc(c);
+      putc(&pb, c);
       continue;
     }
     c = fmt[++i] & 0xff;
@@ -85,39 +193,44 @@ printf(char *fmt, ...)
       break;
     switch(c){
     case 'd':
-      printint(va_arg(ap, int), 10, 1);
+      printint(&pb, va_arg(ap, int), 10, 1);
       break;
     case 'x':
-      printint(va_arg(ap, int), 16, 1);
+      printint(&pb, va_arg(ap, int), 16, 1);
       break;
     case 'p':
-      printptr(va_arg(ap, uint64));
+      printptr(&pb, va_arg(ap, uint64));
       break;
     case 's':
       if((s = va_arg(ap, char*)) == 0)
         s = "(null)";
       for(; *s; s++)
-        consputc(*s);
+        putc(&pb, *s);
       break;
     case '%':
-      consputc('%');
+      putc(&pb, '%');
       break;
     default:
       // Print unknown % sequence to draw attention.
-      consputc('%');
-      consputc(c);
+      putc(&pb, '%');
+      putc(&pb, c);
       break;
     }
   }
+  va_end(ap);
 
-  if(locking)
-    release(&pr.lock);
+  klogwrite(pb.buf, pb.n);
 }
 
 void
 panic(char *s)
 {
-  pr.locking = 0;
+  // print synchronously from now on, starting with whatever
+  // the console hasn't shown.  don't wait for klog.lock; the
+  // CPU holding it might never let go.
+  klog.sync = 1;
+  while(klog.c != klog.w)
+    consputc(klog.buf[klog.c++ % KLOGSIZE]);
   printf("panic: ");
   printf(s);
   printf("\n");
@@ -129,6 +242,5 @@ panic(char *s)
 void
 printfinit(void)
 {
-  initlock(&pr.lock, "pr");
-  pr.locking = 1;
+  initlock(&klog.lock, "klog");
 }
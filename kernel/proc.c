@@ -7,6 +7,8 @@
 #include "fs.h"
 #include "file.h"
 #include "proc.h"
+#include "sysstat.h"
+#include "trace.h"
 #include "defs.h"
 
 struct cpu cpus[NCPU];
@@ -18,8 +20,16 @@ struct proc *initproc;
 int nextpid = 1;
 struct spinlock pid_lock;
 
+// serializes changes to the set of processes sharing a
+// page table (threads made by clone()), to their size, and
+// to the mappings in user page tables that might be shared.
+struct spinlock vm_lock;
+
 extern void forkret(void);
 static void wakeup1(struct proc *chan);
+static void freeproc(struct proc *p);
+static void proc_putpagetable(struct proc *p);
+static int waitchild(uint64 addr, int threads);
 
 extern char trampoline[]; // trampoline.S
 
@@ -29,6 +39,7 @@ procinit(void)
   struct proc *p;
   
   initlock(&pid_lock, "nextpid");
+  initlock(&vm_lock, "vm");
   for(p = proc; p < &proc[NPROC]; p++) {
       initlock(&p->lock, "proc");
 
@@ -116,11 +127,20 @@ found:
 
   // An empty user page table.
   p->pagetable = proc_pagetable(p);
+  p->tfva = TRAPFRAME;
+
+  // A kernel page table into which the user memory is mirrored.
+  if((p->kpagetable = kvmcreate()) == 0){
+    freeproc(p);
+    release(&p->lock);
+    return 0;
+  }
 
   // Set up new context to start executing at forkret,
   // which returns to user space.
   memset(&p->context, 0, sizeof p->context);
   p->context.ra = (uint64)forkret;
+  memset(p->syscount, 0, sizeof(p->syscount));
   p->context.sp = p->kstack + PGSIZE;
 
   return p;
@@ -136,18 +156,62 @@ freeproc(struct proc *p)
     kfree((void*)p->tf);
   p->tf = 0;
   if(p->pagetable)
-    proc_freepagetable(p->pagetable, p->sz);
-  p->pagetable = 0;
+    proc_putpagetable(p);
+  if(p->kpagetable)
+    kvmfree(p->kpagetable);
+  p->kpagetable = 0;
   p->sz = 0;
+  p->guard = 0;
   p->pid = 0;
   p->parent = 0;
   p->name[0] = 0;
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
+  p->thread = 0;
   p->state = UNUSED;
 }
 
+// Drop p's use of its page table, which it may share with
+// threads made by clone().  Only the last user frees the
+// page table and the user memory in it.  When a thread
+// outlives the process that created the address space,
+// that process's trapframe page stays mapped at TRAPFRAME
+// until then; it is not PTE_U, and no thread's sscratch
+// refers to it.
+static void
+proc_putpagetable(struct proc *p)
+{
+  struct proc *pp;
+  int shared = 0;
+
+  acquire(&vm_lock);
+  for(pp = proc; pp < &proc[NPROC]; pp++)
+    if(pp != p && pp->pagetable == p->pagetable)
+      shared = 1;
+  if(p->tfva != TRAPFRAME)
+    uvmunmap(p->pagetable, p->tfva, PGSIZE, 0);
+  if(!shared)
+    proc_freepagetable(p->pagetable, p->sz);
+  p->pagetable = 0;
+  release(&vm_lock);
+}
+
+// Is p's page table shared with other processes?
+int
+vmshared(struct proc *p)
+{
+  struct proc *pp;
+  int shared = 0;
+
+  acquire(&vm_lock);
+  for(pp = proc; pp < &proc[NPROC]; pp++)
+    if(pp != p && pp->pagetable == p->pagetable)
+      shared = 1;
+  release(&vm_lock);
+  return shared;
+}
+
 // Create a page table for a given process,
 // with no user pages, but with trampoline pages.
 pagetable_t
@@ -179,8 +243,7 @@ proc_freepagetable(pagetable_t pagetable, uint64 sz)
 {
   uvmunmap(pagetable, TRAMPOLINE, PGSIZE, 0);
   uvmunmap(pagetable, TRAPFRAME, PGSIZE, 0);
-  if(sz > 0)
-    uvmfree(pagetable, sz);
+  uvmfree(pagetable, sz);
 }
 
 // a user program that calls exec("/init")
@@ -207,6 +270,8 @@ userinit(void)
   // allocate one user page and copy init's instructions
   // and data into it.
   uvminit(p->pagetable, initcode, sizeof(initcode));
+  if(kvmmirror(p->pagetable, p->kpagetable, 0, PGSIZE) < 0)
+    panic("userinit: kvmmirror");
   p->sz = PGSIZE;
 
   // prepare for the very first "return" from kernel to user.
@@ -221,26 +286,60 @@ userinit(void)
   release(&p->lock);
 }
 
-// Grow or shrink user memory by n bytes.
+// Grow or shrink user memory by n bytes, keeping the size
+// and kernel page table mirror of every process sharing
+// the address space (threads made by clone()) in sync.
+// User memory may not grow into the shared-memory slots
+// at SHMBASE.  It may not shrink while the address space
+// is shared: a thread on another CPU could still have the
+// freed pages in its TLB, and there is no way to make that
+// CPU flush it.
 // Return 0 on success, -1 on failure.
 int
 growproc(int n)
 {
-  uint sz;
+  uint64 sz, oldsz;
   struct proc *p = myproc();
+  struct proc *pp, *q;
 
-  sz = p->sz;
+  acquire(&vm_lock);
+  oldsz = sz = p->sz;
   if(n > 0){
-    if((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0) {
-      return -1;
-    }
+    if(sz + n >= SHMBASE)
+      goto bad;
+    if((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0)
+      goto bad;
   } else if(n < 0){
-    if((sz = uvmdealloc(p->pagetable, sz, sz + n)) == 0) {
-      return -1;
+    for(pp = proc; pp < &proc[NPROC]; pp++)
+      if(pp != p && pp->pagetable == p->pagetable)
+        goto bad;
+    if((sz = uvmdealloc(p->pagetable, sz, sz + n)) == 0)
+      goto bad;
+  }
+
+  for(pp = proc; pp < &proc[NPROC]; pp++){
+    if(pp->pagetable != p->pagetable)
+      continue;
+    if(sz < oldsz){
+      kvmunmirror(pp->kpagetable, oldsz, sz);
+    } else if(kvmmirror(p->pagetable, pp->kpagetable, oldsz, sz) < 0){
+      // oldsz's last page was mapped before; keep it.
+      for(q = proc; q <= pp; q++)
+        if(q->pagetable == p->pagetable)
+          kvmunmirror(q->kpagetable, sz, PGROUNDUP(oldsz));
+      uvmdealloc(p->pagetable, sz, PGROUNDUP(oldsz));
+      goto bad;
     }
   }
-  p->sz = sz;
+  for(pp = proc; pp < &proc[NPROC]; pp++)
+    if(pp->pagetable == p->pagetable)
+      pp->sz = sz;
+  release(&vm_lock);
   return 0;
+
+ bad:
+  release(&vm_lock);
+  return -1;
 }
 
 // Create a new process, copying the parent.
@@ -257,13 +356,29 @@ fork(void)
     return -1;
   }
 
-  // Copy user memory from parent to child.
+  // Copy user memory from parent to child.  vm_lock keeps
+  // the parent's threads from changing it meanwhile.
+  acquire(&vm_lock);
   if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0){
+    release(&vm_lock);
     freeproc(np);
     release(&np->lock);
     return -1;
   }
   np->sz = p->sz;
+  np->guard = p->guard;
+  if(kvmmirror(np->pagetable, np->kpagetable, 0, np->sz) < 0){
+    release(&vm_lock);
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  release(&vm_lock);
+  if(shmfork(p, np) < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
 
   np->parent = p;
 
@@ -286,6 +401,79 @@ fork(void)
   np->state = RUNNABLE;
 
   release(&np->lock);
+  timerpoke();
+
+  return pid;
+}
+
+// Create a thread: a new process that shares the caller's
+// page table, and so its memory, and starts at fn(arg) on
+// the user stack whose top is stack.  The thread has its
+// own trapframe, mapped at THREADTRAPFRAME in the shared
+// page table, and its own kernel page table mirror.  Open
+// files are shared as after fork().  fn must not return;
+// the thread ends by calling exit(), and its creator reaps
+// it with join().
+// Returns the new thread's pid, or -1.
+int
+clone(uint64 fn, uint64 arg, uint64 stack)
+{
+  int i, pid;
+  struct proc *np;
+  struct proc *p = myproc();
+
+  if(stack % 16 != 0 || stack > p->sz || stack < PGSIZE)
+    return -1;
+
+  if((np = allocproc()) == 0)
+    return -1;
+
+  // Swap the fresh page table for the caller's.
+  proc_freepagetable(np->pagetable, 0);
+  np->pagetable = 0;
+  np->tfva = THREADTRAPFRAME(np - proc);
+  acquire(&vm_lock);
+  if(mappages(p->pagetable, np->tfva, PGSIZE, (uint64)np->tf, PTE_R | PTE_W) != 0){
+    release(&vm_lock);
+    np->tfva = TRAPFRAME;
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  np->pagetable = p->pagetable;
+  np->sz = p->sz;
+  np->guard = p->guard;
+  np->thread = 1;
+  if(kvmmirror(np->pagetable, np->kpagetable, 0, np->sz) < 0){
+    release(&vm_lock);
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  release(&vm_lock);
+
+  np->parent = p;
+
+  // start at fn(arg) on the new stack.
+  *(np->tf) = *(p->tf);
+  np->tf->epc = fn;
+  np->tf->sp = stack;
+  np->tf->a0 = arg;
+  np->tf->ra = -1;  // returning from fn faults, killing the thread.
+
+  for(i = 0; i < NOFILE; i++)
+    if(p->ofile[i])
+      np->ofile[i] = filedup(p->ofile[i]);
+  np->cwd = idup(p->cwd);
+
+  safestrcpy(np->name, p->name, sizeof(p->name));
+
+  pid = np->pid;
+
+  np->state = RUNNABLE;
+
+  release(&np->lock);
+  timerpoke();
 
   return pid;
 }
@@ -330,6 +518,23 @@ exit(int status)
   if(p == initproc)
     panic("init exiting");
 
+  // A process takes its threads down with it; they are
+  // reparented to init, which reaps them.
+  if(!p->thread){
+    for(struct proc *pp = proc; pp < &proc[NPROC]; pp++){
+      if(pp != p && pp->pagetable == p->pagetable){
+        acquire(&pp->lock);
+        if(pp->pagetable == p->pagetable){
+          pp->killed = 1;
+          if(pp->state == SLEEPING)
+            pp->state = RUNNABLE;
+        }
+        release(&pp->lock);
+        timerpoke();
+      }
+    }
+  }
+
   // Close all open files.
   for(int fd = 0; fd < NOFILE; fd++){
     if(p->ofile[fd]){
@@ -339,6 +544,8 @@ exit(int status)
     }
   }
 
+  shmdetachall(p);
+
   begin_op(ROOTDEV);
   iput(p->cwd);
   end_op(ROOTDEV);
@@ -368,6 +575,23 @@ exit(int status)
 // Return -1 if this process has no children.
 int
 wait(uint64 addr)
+{
+  return waitchild(addr, 0);
+}
+
+// Wait for a thread made by clone() to exit and return its pid.
+// Return -1 if this process has no such threads.
+int
+join(uint64 addr)
+{
+  return waitchild(addr, 1);
+}
+
+// Reap an exited child: a thread if threads is set, otherwise
+// a process.  init reaps both, since it inherits the threads
+// of exited processes.
+static int
+waitchild(uint64 addr, int threads)
 {
   struct proc *np;
   int havekids, pid;
@@ -384,7 +608,7 @@ wait(uint64 addr)
       // this code uses np->parent without holding np->lock.
       // acquiring the lock first would cause a deadlock,
       // since np might be an ancestor, and we already hold p->lock.
-      if(np->parent == p){
+      if(np->parent == p && (np->thread == threads || p == initproc)){
         // np->parent can't change between the check and the acquire()
         // because only the parent changes it, and we're the parent.
         acquire(&np->lock);
@@ -443,21 +667,36 @@ scheduler(void)
         // Switch to chosen process.  It is the process's job
         // to release its lock and then reacquire it
         // before jumping back to us.
+        // Run on the process's kernel page table, which
+        // mirrors its user memory for copyin()/copyout().
         p->state = RUNNING;
         c->proc = p;
+        trace(TR_RUN, p->pid, 0, 0);
+        timerbusy();
+        w_satp(MAKE_SATP(p->kpagetable));
+        sfence_vma();
         swtch(&c->scheduler, &p->context);
+        kvminithart();
 
         // Process is done running for now.
         // It should have changed its p->state before coming back.
         c->proc = 0;
+        trace(TR_STOP, p->pid, p->state, 0);
 
         found = 1;
       }
       release(&p->lock);
     }
     if(found == 0){
+      // nothing to run: don't take clock interrupts just to
+      // look again.  a device interrupt, the timer if a sleep()
+      // is due, or timerpoke() from a CPU that made a process
+      // runnable wakes this CPU.
+      timeridle();
+      uartkick();  // send what printf() left, with no locks held
       intr_on();
       asm volatile("wfi");
+      timerbusy();  // looking again, so not one to poke
     }
   }
 }
@@ -542,6 +781,7 @@ sleep(void *chan, struct spinlock *lk)
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  trace(TR_SLEEP, (uint64)chan, 0, 0);
 
   sched();
 
@@ -561,14 +801,19 @@ void
 wakeup(void *chan)
 {
   struct proc *p;
+  int woke = 0;
 
   for(p = proc; p < &proc[NPROC]; p++) {
     acquire(&p->lock);
     if(p->state == SLEEPING && p->chan == chan) {
       p->state = RUNNABLE;
+      trace(TR_WAKEUP, p->pid, (uint64)chan, 0);
+      woke = 1;
     }
     release(&p->lock);
   }
+  if(woke)
+    timerpoke();
 }
 
 // Wake up p if it is sleeping in wait(); used by exit().
@@ -578,6 +823,7 @@ wakeup1(struct proc *p)
 {
   if(p->chan == p && p->state == SLEEPING) {
     p->state = RUNNABLE;
+    timerpoke();
   }
 }
 
@@ -598,6 +844,7 @@ kill(int pid)
         p->state = RUNNABLE;
       }
       release(&p->lock);
+      timerpoke();
       return 0;
     }
     release(&p->lock);
@@ -635,6 +882,51 @@ either_copyin(void *dst, int user_src, uint64 src, uint64 len)
   }
 }
 
+// Copy process pid's system call counts for numbers 0..n-1 to
+// the struct sysstat array at user address dst.  The counts are
+// copied a few at a time into a buffer under p->lock, and from
+// there to dst without it, since copyout() may sleep.
+// Returns 0, or -1 if there is no such process.
+int
+procsysstat(int pid, uint64 dst, int n)
+{
+  struct proc *p;
+  struct sysstat st[8];
+  int num, m, i;
+
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->pid == pid && p->state != UNUSED){
+      release(&p->lock);
+      break;
+    }
+    release(&p->lock);
+  }
+  if(p == &proc[NPROC])
+    return -1;
+
+  for(num = 0; num < n; num += m){
+    acquire(&p->lock);
+    if(p->pid != pid || p->state == UNUSED){
+      // exited meanwhile.
+      release(&p->lock);
+      return -1;
+    }
+    m = n - num < NELEM(st) ? n - num : NELEM(st);
+    for(i = 0; i < m; i++){
+      st[i].count = p->syscount[num+i].count;
+      st[i].cycles = p->syscount[num+i].cycles;
+      st[i].max = p->syscount[num+i].max;
+      memmove(st[i].hist, p->syscount[num+i].hist, sizeof(st[i].hist));
+    }
+    release(&p->lock);
+    if(copyout(myproc()->pagetable, dst + num*sizeof(st[0]),
+               (char*)st, m * sizeof(st[0])) < 0)
+      return -1;
+  }
+  return 0;
+}
+
 // Print a process listing to console.  For debugging.
 // Runs when user types ^P on console.
 // No lock to avoid wedging a stuck machine further.
@@ -24,6 +24,7 @@ struct cpu {
   struct context scheduler;   // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  int idle;                   // Tick stopped by timeridle()?
 };
 
 extern struct cpu cpus[NCPU];
@@ -80,6 +81,14 @@ struct trapframe {
   /* 280 */ uint64 t6;
 };
 
+// per-process system call counts; see sysstat().
+struct syscount {
+  uint64 count;
+  uint64 cycles;
+  uint64 max;
+  uint64 hist[NSYSHIST];  // as in struct sysstat
+};
+
 enum procstate { UNUSED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
@@ -96,11 +105,17 @@ struct proc {
 
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Bottom of kernel stack for this process
-  uint64 sz;                   // Size of process memory (bytes)
-  pagetable_t pagetable;       // Page table
+  uint64 sz;                   // Size of process memory (bytes); vm_lock to change
+  uint64 guard;                // exec()'s stack guard page, or 0
+  pagetable_t pagetable;       // Page table, shared by clone()d threads
+  pagetable_t kpagetable;      // Kernel page table, mirroring user memory
   struct trapframe *tf;        // data page for trampoline.S
+  uint64 tfva;                 // user address of tf: TRAPFRAME, or THREADTRAPFRAME
+  int thread;                  // made by clone(); reaped by join()
   struct context context;      // swtch() here to run process
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
+  struct shmseg *shm[NSHMPROC]; // Attached shared-memory segments
+  struct syscount syscount[NSYSCALL]; // Calls made, by number
   char name[16];               // Process name (debugging)
 };
@@ -0,0 +1,170 @@
+//
+// Sampling profiler.
+//
+// While profiling is on, each CPU takes a sample at every timer
+// interrupt: the interrupted pc; if that was kernel code, its
+// callers, found by following the frame pointers that
+// -fno-omit-frame-pointer keeps; and the user pc and callers of
+// the current process, if any.
+//
+// The prof device (major PROF) is an event device (see evdev.c)
+// that hands the samples out as struct profsample (see prof.h).
+// Writing '1' to it starts profiling, '0' stops it.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "proc.h"
+#include "prof.h"
+#include "evdev.h"
+#include "defs.h"
+
+#define NPROFBUF 128  // samples in each CPU's ring
+
+static struct profsample profbuf[NCPU][NPROFBUF];
+static struct evdev prof;
+
+extern char kernelvecret[];  // in kernelvec.S, where kerneltrap() returns
+
+static void
+push(struct profsample *s, uint64 pc)
+{
+  if(s->depth < NPROFDEPTH)
+    s->pc[s->depth++] = pc;
+}
+
+// Append the return addresses of the kernel frames from fp on.
+// Kernel stacks are a page, so the chain must stay above lo,
+// the bottom of the current stack's page.
+static void
+kernelchain(struct profsample *s, uint64 fp, uint64 lo)
+{
+  uint64 ra, next;
+
+  while(s->depth < NPROFDEPTH){
+    if(fp < lo + 16 || fp > lo + PGSIZE || (fp & 7) != 0)
+      break;
+    ra = *(uint64*)(fp - 8);
+    next = *(uint64*)(fp - 16);
+    if(ra < KERNBASE)
+      break;  // usertrap() is entered by a jump from uservec
+    push(s, ra);
+    if(next <= fp)
+      break;
+    fp = next;
+  }
+}
+
+// Read the user word at va without faulting.
+// Returns 0, or -1 if va isn't mapped.
+static int
+userword(pagetable_t pagetable, uint64 va, uint64 *x)
+{
+  uint64 pa;
+
+  if((va & 7) != 0 || va >= MAXVA)
+    return -1;
+  if((pa = walkaddr(pagetable, PGROUNDDOWN(va))) == 0)
+    return -1;
+  *x = *(uint64*)(pa + va - PGROUNDDOWN(va));
+  return 0;
+}
+
+// Append p's user pc and the return addresses of its frames.
+static void
+userchain(struct profsample *s, struct proc *p)
+{
+  uint64 fp, ra, next;
+
+  push(s, p->tf->epc);
+  fp = p->tf->s0;
+  while(s->depth < NPROFDEPTH){
+    if(userword(p->pagetable, fp - 8, &ra) < 0 ||
+       userword(p->pagetable, fp - 16, &next) < 0)
+      break;
+    push(s, ra);
+    if(next <= fp)
+      break;
+    fp = next;
+  }
+}
+
+// Take a sample of what this CPU was doing when the timer
+// interrupted it.  Called by devintr() with interrupts off.
+void
+profintr(void)
+{
+  struct profsample *s;
+  struct proc *p;
+  uint64 fp, lo;
+
+  if((s = evput(&prof)) == 0)
+    return;
+
+  s->depth = 0;
+  if(r_sstatus() & SSTATUS_SPP){
+    push(s, r_sepc());
+    // find kerneltrap()'s frame.  kernelvec leaves s0 alone,
+    // so the frame pointer kerneltrap() saved is that of the
+    // code it interrupted.
+    fp = r_fp();
+    lo = PGROUNDDOWN(fp);
+    while(fp >= lo + 16 && fp <= lo + PGSIZE){
+      if(*(uint64*)(fp - 8) == (uint64)kernelvecret){
+        kernelchain(s, *(uint64*)(fp - 16), lo);
+        break;
+      }
+      if(*(uint64*)(fp - 16) <= fp)
+        break;
+      fp = *(uint64*)(fp - 16);
+    }
+  }
+  s->nkernel = s->depth;
+
+  p = myproc();
+  if(p){
+    s->pid = p->pid;
+    safestrcpy(s->name, p->name, sizeof(s->name));
+    userchain(s, p);
+  } else {
+    s->pid = 0;
+    safestrcpy(s->name, "scheduler", sizeof(s->name));
+  }
+  evputdone(&prof);
+}
+
+// A sample with pid -1 says how many were lost.
+static void
+proflost(void *rec, int cpu, uint n)
+{
+  struct profsample *s = rec;
+
+  s->pid = -1;
+  s->pc[0] = n;
+}
+
+static int
+profread(int user_dst, uint64 dst, int n)
+{
+  return evread(&prof, user_dst, dst, n);
+}
+
+static int
+profwrite(int user_src, uint64 src, int n)
+{
+  return evwrite(&prof, user_src, src, n);
+}
+
+void
+profinit(void)
+{
+  evinit(&prof, "prof", profbuf, sizeof(struct profsample), NPROFBUF, proflost);
+  devsw[PROF].read = profread;
+  devsw[PROF].write = profwrite;
+}
@@ -0,0 +1,15 @@
+#define NPROFDEPTH 16  // most pcs in one profiler sample
+
+// One sample of the profiler, as read from the prof device.
+// pc[0] is the interrupted pc.  If the sample was taken in the
+// kernel, pc[0..nkernel-1] are kernel pcs, innermost first;
+// the rest of pc[] are the process's user pc and its callers.
+// A sample with pid -1 records that pc[0] samples were lost
+// because nobody read them in time.
+struct profsample {
+  int pid;               // 0 if the CPU had no process
+  uchar depth;           // entries used in pc[]
+  uchar nkernel;         // how many of them are kernel pcs
+  char name[16];         // process name
+  uint64 pc[NPROFDEPTH];
+};
@@ -0,0 +1,212 @@
+//
+// Shared-memory segments.
+//
+// A segment is a set of physical pages, named by an integer
+// key, that can be mapped into several processes at once, so
+// that they can exchange data without copying it through the
+// kernel.  Each attachment occupies one of a process's NSHMPROC
+// fixed slots just below PLIC (see SHMSLOT in memlayout.h).
+// shmtable.seg[i].ref counts attachments; a segment's pages are
+// freed when its last attachment is removed by shmdt(), exec()
+// or exit().  fork() gives the child its own attachment to each
+// of the parent's segments.  Threads made by clone() see each
+// other's attachments through their shared page table, but each
+// attachment belongs to the thread that made it.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+struct shmseg {
+  int key;
+  int ref;      // number of attachments; 0 means free
+  int npages;
+  char *pages[SHMMAXPAGES];
+};
+
+struct {
+  struct spinlock lock;
+  struct shmseg seg[NSHM];
+} shmtable;
+
+void
+shminit(void)
+{
+  initlock(&shmtable.lock, "shm");
+}
+
+// Free the pages of a segment with no attachments.
+// Caller must hold shmtable.lock.
+static void
+shmfree(struct shmseg *s)
+{
+  for(int i = 0; i < s->npages; i++)
+    kfree(s->pages[i]);
+  s->npages = 0;
+}
+
+// Find the segment named key, or create one of npages
+// zeroed pages if there is none and npages > 0.
+// Caller must hold shmtable.lock.
+static struct shmseg*
+shmlookup(int key, int npages)
+{
+  struct shmseg *s, *empty;
+  int i;
+
+  empty = 0;
+  for(s = shmtable.seg; s < &shmtable.seg[NSHM]; s++){
+    if(s->ref > 0 && s->key == key)
+      return npages <= s->npages ? s : 0;
+    if(empty == 0 && s->ref == 0)
+      empty = s;
+  }
+  if(empty == 0 || npages == 0)
+    return 0;
+
+  s = empty;
+  for(i = 0; i < npages; i++){
+    if((s->pages[i] = kalloc()) == 0){
+      s->npages = i;
+      shmfree(s);
+      return 0;
+    }
+    memset(s->pages[i], 0, PGSIZE);
+  }
+  s->key = key;
+  s->npages = npages;
+  return s;
+}
+
+// Map segment s into slot i of p's address space.
+// Caller must hold shmtable.lock.
+// Returns 0 on success, -1 if out of memory.
+static int
+shmmap(struct proc *p, int i, struct shmseg *s)
+{
+  uint64 va = SHMSLOT(i);
+  int j;
+
+  acquire(&vm_lock);
+  for(j = 0; j < s->npages; j++){
+    if(mappages(p->pagetable, va + j*PGSIZE, PGSIZE,
+                (uint64)s->pages[j], PTE_R|PTE_W|PTE_U) != 0){
+      if(j > 0)
+        uvmunmap(p->pagetable, va, j*PGSIZE, 0);
+      release(&vm_lock);
+      return -1;
+    }
+  }
+  release(&vm_lock);
+  s->ref++;
+  p->shm[i] = s;
+  return 0;
+}
+
+// Remove the segment in slot i from p's address space,
+// freeing it if that was the last attachment.
+// Caller must hold shmtable.lock.
+static void
+shmunmap(struct proc *p, int i)
+{
+  struct shmseg *s = p->shm[i];
+
+  acquire(&vm_lock);
+  uvmunmap(p->pagetable, SHMSLOT(i), s->npages*PGSIZE, 0);
+  release(&vm_lock);
+  p->shm[i] = 0;
+  if(--s->ref == 0)
+    shmfree(s);
+}
+
+// Attach the segment named key to the current process,
+// creating it with size bytes if it doesn't exist yet.
+// size 0 only attaches an existing segment.
+// Returns the segment's user address, or -1.
+uint64
+shmat(int key, int size)
+{
+  struct proc *p = myproc();
+  struct shmseg *s;
+  int i;
+
+  if(size < 0 || size > SHMMAXPAGES*PGSIZE)
+    return -1;
+
+  acquire(&shmtable.lock);
+  // a thread sharing p's page table may have taken the slot.
+  for(i = 0; i < NSHMPROC; i++)
+    if(p->shm[i] == 0 && walkaddr(p->pagetable, SHMSLOT(i)) == 0)
+      break;
+  if(i == NSHMPROC)
+    goto bad;
+  if((s = shmlookup(key, PGROUNDUP(size) / PGSIZE)) == 0)
+    goto bad;
+  if(shmmap(p, i, s) < 0){
+    if(s->ref == 0)
+      shmfree(s);
+    goto bad;
+  }
+  release(&shmtable.lock);
+  return SHMSLOT(i);
+
+ bad:
+  release(&shmtable.lock);
+  return -1;
+}
+
+// Detach the segment attached at user address va.
+// Returns 0 on success, -1 if nothing is attached there.
+int
+shmdt(uint64 va)
+{
+  struct proc *p = myproc();
+  int i;
+
+  acquire(&shmtable.lock);
+  for(i = 0; i < NSHMPROC; i++){
+    if(p->shm[i] && SHMSLOT(i) == va){
+      shmunmap(p, i);
+      release(&shmtable.lock);
+      return 0;
+    }
+  }
+  release(&shmtable.lock);
+  return -1;
+}
+
+// Detach all of p's segments; used by exec() and exit().
+void
+shmdetachall(struct proc *p)
+{
+  acquire(&shmtable.lock);
+  for(int i = 0; i < NSHMPROC; i++)
+    if(p->shm[i])
+      shmunmap(p, i);
+  release(&shmtable.lock);
+}
+
+// Attach each of p's segments to np at the same address.
+// Returns 0 on success; on failure detaches whatever it
+// attached and returns -1.
+int
+shmfork(struct proc *p, struct proc *np)
+{
+  acquire(&shmtable.lock);
+  for(int i = 0; i < NSHMPROC; i++){
+    if(p->shm[i] && shmmap(np, i, p->shm[i]) < 0){
+      for(i = 0; i < NSHMPROC; i++)
+        if(np->shm[i])
+          shmunmap(np, i);
+      release(&shmtable.lock);
+      return -1;
+    }
+  }
+  release(&shmtable.lock);
+  return 0;
+}
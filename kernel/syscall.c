@@ -6,6 +6,8 @@
 #include "proc.h"
 #include "syscall.h"
 #include "defs.h"
+#include "uio.h"
+#include "sysstat.h"
 
 // Fetch the uint64 at addr from the current process.
 int
@@ -107,8 +109,25 @@ extern uint64 sys_write(void);
 extern uint64 sys_uptime(void);
 extern uint64 sys_ntas(void);
 extern uint64 sys_crash(void);
+extern uint64 sys_shmat(void);
+extern uint64 sys_shmdt(void);
+extern uint64 sys_futex_wait(void);
+extern uint64 sys_futex_wake(void);
+extern uint64 sys_clone(void);
+extern uint64 sys_join(void);
+extern uint64 sys_pread(void);
+extern uint64 sys_pwrite(void);
+extern uint64 sys_fsync(void);
+extern uint64 sys_ftruncate(void);
+extern uint64 sys_sendfile(void);
+extern uint64 sys_splice(void);
+extern uint64 sys_readv(void);
+extern uint64 sys_writev(void);
+extern uint64 sys_sysbatch(void);
+extern uint64 sys_sysstat(void);
+extern uint64 sys_dmesg(void);
 
-static uint64 (*syscalls[])(void) = {
+static uint64 (*syscalls[NSYSCALL])(void) = {
 [SYS_fork]    sys_fork,
 [SYS_exit]    sys_exit,
 [SYS_wait]    sys_wait,
@@ -132,17 +151,155 @@ static uint64 (*syscalls[])(void) = {
 [SYS_close]   sys_close,
 [SYS_ntas]    sys_ntas,
 [SYS_crash]   sys_crash,
+[SYS_shmat]   sys_shmat,
+[SYS_shmdt]   sys_shmdt,
+[SYS_futex_wait] sys_futex_wait,
+[SYS_futex_wake] sys_futex_wake,
+[SYS_clone]   sys_clone,
+[SYS_join]    sys_join,
+[SYS_pread]   sys_pread,
+[SYS_pwrite]  sys_pwrite,
+[SYS_fsync]   sys_fsync,
+[SYS_ftruncate] sys_ftruncate,
+[SYS_sendfile] sys_sendfile,
+[SYS_splice]  sys_splice,
+[SYS_readv]   sys_readv,
+[SYS_writev]  sys_writev,
+[SYS_sysbatch] sys_sysbatch,
+[SYS_sysstat] sys_sysstat,
+[SYS_dmesg]   sys_dmesg,
 };
 
+// System-wide counts, kept per CPU so that CPUs don't share
+// the cache lines they update; sys_sysstat() adds them up.
+static struct sysstat cpustat[NCPU][NSYSCALL];
+
+// Charge a call of num that took cycles to p and to this CPU.
+static void
+sysaccount(struct proc *p, int num, uint64 cycles)
+{
+  struct syscount *c = &p->syscount[num];
+  struct sysstat *st;
+  int i;
+
+  c->count++;
+  c->cycles += cycles;
+  if(cycles > c->max)
+    c->max = cycles;
+  for(i = 0; i < NSYSHIST-1 && cycles >= (16UL << i); i++)
+    ;
+  c->hist[i]++;
+
+  push_off();
+  st = &cpustat[cpuid()][num];
+  st->count++;
+  st->cycles += cycles;
+  if(cycles > st->max)
+    st->max = cycles;
+  st->hist[i]++;
+  pop_off();
+}
+
+// Copy the counts for system call numbers 0..n-1 to the struct
+// sysstat array at user address a1: those of process a0, or if
+// a0 is 0, the whole system's.  Returns NSYSCALL, or -1.
+uint64
+sys_sysstat(void)
+{
+  struct sysstat st, *c;
+  uint64 dst;
+  int pid, n, num, cpu, i;
+
+  if(argint(0, &pid) < 0 || argaddr(1, &dst) < 0 || argint(2, &n) < 0 || n < 0)
+    return -1;
+  if(n > NSYSCALL)
+    n = NSYSCALL;
+  if(pid != 0)
+    return procsysstat(pid, dst, n) < 0 ? -1 : NSYSCALL;
+
+  for(num = 0; num < n; num++){
+    memset(&st, 0, sizeof(st));
+    for(cpu = 0; cpu < NCPU; cpu++){
+      c = &cpustat[cpu][num];
+      st.count += c->count;
+      st.cycles += c->cycles;
+      if(c->max > st.max)
+        st.max = c->max;
+      for(i = 0; i < NSYSHIST; i++)
+        st.hist[i] += c->hist[i];
+    }
+    if(copyout(myproc()->pagetable, dst + num*sizeof(st), (char*)&st, sizeof(st)) < 0)
+      return -1;
+  }
+  return NSYSCALL;
+}
+
+// Run each of the n system calls described by the struct sysreq
+// array at user address a0, setting its ret, all in one trap.
+// Calls that need the trapframe to be the caller's own (fork,
+// exec, exit, clone and sysbatch) are refused with -1, as are
+// unknown ones.  Each call is counted under its own number, and
+// sysbatch only for the time around them, so no time is counted
+// twice; syscall() leaves sysbatch to do this itself.  Returns
+// the number of requests run, which is less than n if a request
+// couldn't be fetched or the process was killed.
+uint64
+sys_sysbatch(void)
+{
+  struct proc *p = myproc();
+  struct trapframe tf = *p->tf;
+  struct sysreq r;
+  uint64 reqs, start, t0, inner;
+  int i, n;
+
+  start = r_time();
+  inner = 0;
+  if(argaddr(0, &reqs) < 0 || argint(1, &n) < 0){
+    sysaccount(p, SYS_sysbatch, r_time() - start);
+    return -1;
+  }
+  for(i = 0; i < n && !p->killed; i++){
+    if(copyin(p->pagetable, (char*)&r, reqs + i*sizeof(r), sizeof(r)) < 0)
+      break;
+    if(r.num <= 0 || r.num >= NELEM(syscalls) || syscalls[r.num] == 0 ||
+       r.num == SYS_fork || r.num == SYS_exec || r.num == SYS_exit ||
+       r.num == SYS_clone || r.num == SYS_sysbatch){
+      r.ret = -1;
+    } else {
+      p->tf->a0 = r.arg[0];
+      p->tf->a1 = r.arg[1];
+      p->tf->a2 = r.arg[2];
+      p->tf->a3 = r.arg[3];
+      p->tf->a4 = r.arg[4];
+      p->tf->a5 = r.arg[5];
+      p->tf->a7 = r.num;
+      t0 = r_time();
+      r.ret = syscalls[r.num]();
+      t0 = r_time() - t0;
+      sysaccount(p, r.num, t0);
+      inner += t0;
+    }
+    if(copyout(p->pagetable, reqs + i*sizeof(r), (char*)&r, sizeof(r)) < 0)
+      break;
+  }
+  *p->tf = tf;
+  sysaccount(p, SYS_sysbatch, r_time() - start - inner);
+  return i;
+}
+
 void
 syscall(void)
 {
   int num;
   struct proc *p = myproc();
+  uint64 t0;
 
   num = p->tf->a7;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
+    t0 = r_time();
     p->tf->a0 = syscalls[num]();
+    if(num != SYS_sysbatch)
+      sysaccount(p, num, r_time() - t0);
   } else {
     printf("%d %s: unknown sys call %d\n",
             p->pid, p->name, num);
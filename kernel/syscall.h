@@ -26,3 +26,21 @@
 #define SYS_crash  23
 #define SYS_mount  24
 #define SYS_umount 25
+
+#define SYS_shmat  26
+#define SYS_shmdt  27
+#define SYS_futex_wait 28
+#define SYS_futex_wake 29
+#define SYS_clone  30
+#define SYS_join   31
+#define SYS_pread  32
+#define SYS_pwrite 33
+#define SYS_fsync  34
+#define SYS_ftruncate 35
+#define SYS_sendfile 36
+#define SYS_splice 37
+#define SYS_readv  38
+#define SYS_writev 39
+#define SYS_sysbatch 40
+#define SYS_sysstat 41
+#define SYS_dmesg  42
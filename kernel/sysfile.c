@@ -15,6 +15,7 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "uio.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -91,6 +92,131 @@ sys_write(void)
   return filewrite(f, p, n);
 }
 
+// Read or write f for each of the iovcnt buffers described
+// by the struct iovec array at user address iov, in turn,
+// stopping after a short transfer.  Returns the number of
+// bytes moved, or -1 if nothing was.
+static int
+fileiov(struct file *f, uint64 iov, int iovcnt, int write)
+{
+  struct proc *p = myproc();
+  struct iovec v[MAXIOV];
+  int i, r, tot;
+
+  if(iovcnt < 0 || iovcnt > MAXIOV ||
+     copyin(p->pagetable, (char*)v, iov, iovcnt*sizeof(v[0])) < 0)
+    return -1;
+  tot = 0;
+  for(i = 0; i < iovcnt; i++){
+    if(v[i].len < 0)
+      return -1;
+    if(write)
+      r = filewrite(f, (uint64)v[i].base, v[i].len);
+    else
+      r = fileread(f, (uint64)v[i].base, v[i].len);
+    if(r < 0)
+      return tot > 0 ? tot : -1;
+    tot += r;
+    if(r < v[i].len)
+      break;
+  }
+  return tot;
+}
+
+uint64
+sys_readv(void)
+{
+  struct file *f;
+  int n;
+  uint64 p;
+
+  if(argfd(0, 0, &f) < 0 || argaddr(1, &p) < 0 || argint(2, &n) < 0)
+    return -1;
+  return fileiov(f, p, n, 0);
+}
+
+uint64
+sys_writev(void)
+{
+  struct file *f;
+  int n;
+  uint64 p;
+
+  if(argfd(0, 0, &f) < 0 || argaddr(1, &p) < 0 || argint(2, &n) < 0)
+    return -1;
+  return fileiov(f, p, n, 1);
+}
+
+uint64
+sys_pread(void)
+{
+  struct file *f;
+  int n, off;
+  uint64 p;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argaddr(1, &p) < 0 ||
+     argint(3, &off) < 0 || off < 0)
+    return -1;
+  return filepread(f, p, n, off);
+}
+
+uint64
+sys_pwrite(void)
+{
+  struct file *f;
+  int n, off;
+  uint64 p;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argaddr(1, &p) < 0 ||
+     argint(3, &off) < 0 || off < 0)
+    return -1;
+  return filepwrite(f, p, n, off);
+}
+
+uint64
+sys_sendfile(void)
+{
+  struct file *out, *in;
+  int off, n;
+
+  if(argfd(0, 0, &out) < 0 || argfd(1, 0, &in) < 0 ||
+     argint(2, &off) < 0 || argint(3, &n) < 0 || off < -1)
+    return -1;
+  return filesendfile(out, in, off, n);
+}
+
+uint64
+sys_splice(void)
+{
+  struct file *in, *out;
+  int n;
+
+  if(argfd(0, 0, &in) < 0 || argfd(1, 0, &out) < 0 || argint(2, &n) < 0)
+    return -1;
+  return filesplice(in, out, n);
+}
+
+uint64
+sys_fsync(void)
+{
+  struct file *f;
+
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  return filesync(f);
+}
+
+uint64
+sys_ftruncate(void)
+{
+  struct file *f;
+  int size;
+
+  if(argfd(0, 0, &f) < 0 || argint(1, &size) < 0 || size < 0)
+    return -1;
+  return filetruncate(f, size);
+}
+
 uint64
 sys_close(void)
 {
@@ -165,22 +291,6 @@ bad:
   return -1;
 }
 
-// Is the directory dp empty except for "." and ".." ?
-static int
-isdirempty(struct inode *dp)
-{
-  int off;
-  struct dirent de;
-
-  for(off=2*sizeof(de); off<dp->size; off+=sizeof(de)){
-    if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-      panic("isdirempty: readi");
-    if(de.inum != 0)
-      return 0;
-  }
-  return 1;
-}
-
 uint64
 sys_unlink(void)
 {
@@ -218,6 +328,9 @@ sys_unlink(void)
   memset(&de, 0, sizeof(de));
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
     panic("unlink: writei");
+  dcacheenter(dp->dev, dp->inum, name, 0);
+  if(off < dp->dirfree)
+    dp->dirfree = off;
   if(ip->type == T_DIR){
     dp->nlink--;
     iupdate(dp);
@@ -0,0 +1,14 @@
+// Counts for one system call number, as returned by sysstat().
+// Times are in cycles of the time CSR.  hist[i] counts the calls
+// that took fewer than 16<<i cycles but at least half that;
+// hist[0] also counts the quicker ones, and hist[NSYSHIST-1]
+// all the slower ones (NSYSHIST is in param.h).  A call made through sysbatch() counts under its
+// own number; sysbatch's count has only the time spent around
+// the calls it made, so the cycles of all numbers add up to
+// the time spent in system calls.
+struct sysstat {
+  uint64 count;   // calls that returned
+  uint64 cycles;  // total time spent in them
+  uint64 max;     // longest call
+  uint64 hist[NSYSHIST];
+};
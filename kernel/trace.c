@@ -0,0 +1,86 @@
+//
+// Kernel event tracing.
+//
+// Tracepoints in the scheduler, buffer cache, log, disk driver
+// and trap handlers call trace(), which, while tracing is on,
+// logs a struct traceevent (see trace.h) in the current CPU's
+// ring of the trace device (major TRACE), an event device (see
+// evdev.c).  Logging an event takes no lock and never waits, so
+// tracepoints can sit inside wakeup() and the scheduler.
+// Writing '1' to the device starts tracing, '0' stops it.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "proc.h"
+#include "trace.h"
+#include "evdev.h"
+#include "defs.h"
+
+#define NTRACEBUF 512  // events in each CPU's ring
+
+static struct traceevent tracebuf[NCPU][NTRACEBUF];
+static struct evdev tracing;
+
+// Record an event of the given type in this CPU's ring.
+void
+trace(int type, uint64 a0, uint64 a1, uint64 a2)
+{
+  struct traceevent *e;
+  struct cpu *c;
+
+  if(!tracing.on)
+    return;
+
+  push_off();
+  if((e = evput(&tracing)) != 0){
+    c = mycpu();
+    e->time = r_time();
+    e->type = type;
+    e->cpu = cpuid();
+    e->pid = c->proc ? c->proc->pid : 0;
+    e->arg[0] = a0;
+    e->arg[1] = a1;
+    e->arg[2] = a2;
+    evputdone(&tracing);
+  }
+  pop_off();
+}
+
+// A TR_LOST event says how many were lost.
+static void
+tracelost(void *rec, int cpu, uint n)
+{
+  struct traceevent *e = rec;
+
+  e->time = r_time();
+  e->type = TR_LOST;
+  e->cpu = cpu;
+  e->arg[0] = n;
+}
+
+static int
+traceread(int user_dst, uint64 dst, int n)
+{
+  return evread(&tracing, user_dst, dst, n);
+}
+
+static int
+tracewrite(int user_src, uint64 src, int n)
+{
+  return evwrite(&tracing, user_src, src, n);
+}
+
+void
+traceinit(void)
+{
+  evinit(&tracing, "trace", tracebuf, sizeof(struct traceevent), NTRACEBUF, tracelost);
+  devsw[TRACE].read = traceread;
+  devsw[TRACE].write = tracewrite;
+}
@@ -0,0 +1,31 @@
+// Kernel trace events, as read from the trace device.
+// Each records the time CSR, the CPU and the pid of the
+// process it was running (0 if none), and up to three
+// arguments, listed here for each type.
+enum {
+  TR_TRAP = 1,      // scause, sepc, syscall number
+  TR_RUN,           // pid the scheduler switched to
+  TR_STOP,          // pid that gave up the CPU, its new state
+  TR_SLEEP,         // chan
+  TR_WAKEUP,        // pid made runnable, chan
+  TR_BHIT,          // dev, blockno found in the buffer cache
+  TR_BMISS,         // dev, blockno not in the cache
+  TR_BEVICT,        // dev, blockno whose buffer the miss reused
+  TR_BEGINOP,       // dev, blocks reserved
+  TR_ENDOP,         // dev, operations still outstanding
+  TR_COMMIT,        // dev, blocks in the transaction
+  TR_COMMITLOGGED,  // dev, seq: the transaction is on disk
+  TR_COMMITDONE,    // dev, seq: installed in place
+  TR_DISKSTART,     // disk, blockno, write
+  TR_DISKDONE,      // disk, blockno
+  TR_LOST,          // events dropped because nobody read them
+  NTRACETYPE
+};
+
+struct traceevent {
+  uint64 time;
+  ushort type;
+  uchar cpu;
+  int pid;
+  uint64 arg[3];
+};
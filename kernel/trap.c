@@ -4,11 +4,17 @@
 #include "riscv.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "trace.h"
 #include "defs.h"
 
 struct spinlock tickslock;
 uint ticks;
 
+// the time, in time-CSR cycles, by which the earliest tickwait()
+// wants ticks to have moved; -1 if nobody is waiting.  idle
+// CPUs set their timers for it (see timeridle()).
+static uint64 nextwake = -1;
+
 extern char trampoline[], uservec[], userret[];
 
 // in kernelvec.S, calls kerneltrap().
@@ -49,6 +55,7 @@ usertrap(void)
   
   // save user program counter.
   p->tf->epc = r_sepc();
+  trace(TR_TRAP, r_scause(), r_sepc(), r_scause() == 8 ? p->tf->a7 : 0);
   
   if(r_scause() == 8){
     // system call
@@ -124,7 +131,7 @@ usertrapret(void)
   // switches to the user page table, restores user registers,
   // and switches to user mode with sret.
   uint64 fn = TRAMPOLINE + (userret - trampoline);
-  ((void (*)(uint64,uint64))fn)(TRAPFRAME, satp);
+  ((void (*)(uint64,uint64))fn)(p->tfva, satp);
 }
 
 // interrupts and exceptions from kernel code go here via kernelvec,
@@ -142,6 +149,7 @@ kerneltrap()
     panic("kerneltrap: not from supervisor mode");
   if(intr_get() != 0)
     panic("kerneltrap: interrupts enabled");
+  trace(TR_TRAP, scause, sepc, 0);
 
   if((which_dev = devintr()) == 0){
     printf("scause %p\n", scause);
@@ -159,12 +167,89 @@ kerneltrap()
   w_sstatus(sstatus);
 }
 
+// ticks counts clock ticks of TICKCYCLES since boot.  idle
+// CPUs stop their timers, so there may be no timer interrupt
+// for a long time; rather than counting interrupts, bring ticks
+// up to date with the time CSR, and wake up everyone waiting on
+// it if it moved.  the caller holds tickslock.
+void
+ticksync(void)
+{
+  uint t = r_time() / TICKCYCLES;
+
+  if(t != ticks){
+    ticks = t;
+    nextwake = -1;  // the sleepers will tickwait() again if need be
+    wakeup(&ticks);
+  }
+}
+
+// sleep until ticks reaches t, or ticks moves and something
+// else might be worth checking.  the caller holds tickslock.
+void
+tickwait(uint t)
+{
+  if((uint64)t * TICKCYCLES < nextwake)
+    nextwake = (uint64)t * TICKCYCLES;
+  sleep(&ticks, &tickslock);
+}
+
+// this CPU has nothing to run: stop its timer, or if someone
+// is in tickwait(), set it to go off when they should wake.
+// called from scheduler() on the kernel page table, which maps
+// CLINT.
+void
+timeridle(void)
+{
+  *(uint64*)CLINT_MTIMECMP(cpuid()) = nextwake;
+  __sync_synchronize();  // before timerpoke() can see idle
+  mycpu()->idle = 1;
+}
+
+// this CPU is about to run a process, or to look for one:
+// restart the tick that preempts it, if timeridle() stopped it
+// and timerpoke() hasn't already.
+void
+timerbusy(void)
+{
+  if(__sync_bool_compare_and_swap(&mycpu()->idle, 1, 0))
+    *(uint64*)CLINT_MTIMECMP(cpuid()) = r_time() + TICKCYCLES;
+}
+
+// a process has become runnable: if another CPU is idle, make
+// its timer go off now so that its scheduler runs the process,
+// instead of leaving it for a busy CPU's next tick.  timervec
+// then carries on with a tick from now.  may be called on a
+// process's kernel page table, which doesn't map CLINT.
+void
+timerpoke(void)
+{
+  extern pagetable_t kernel_pagetable;
+  struct cpu *c;
+  uint64 satp;
+
+  push_off();
+  for(c = cpus; c < &cpus[NCPU]; c++){
+    if(c != mycpu() && c->idle && __sync_bool_compare_and_swap(&c->idle, 1, 0)){
+      satp = r_satp();
+      w_satp(MAKE_SATP(kernel_pagetable));
+      sfence_vma();
+      *(uint64*)CLINT_MTIMECMP(c - cpus) = r_time();
+      w_satp(satp);
+      sfence_vma();
+      break;
+    }
+  }
+  pop_off();
+}
+
 void
 clockintr()
 {
+  if(r_time() / TICKCYCLES == ticks)
+    return;  // another CPU got here first
   acquire(&tickslock);
-  ticks++;
-  wakeup(&ticks);
+  ticksync();
   release(&tickslock);
 }
 
@@ -197,9 +282,9 @@ devintr()
     // software interrupt from a machine-mode timer interrupt,
     // forwarded by timervec in kernelvec.S.
 
-    if(cpuid() == 0){
-      clockintr();
-    }
+    profintr();
+    clockintr();
+    uartkick();  // in case printf() couldn't
     
     // acknowledge the software interrupt by clearing
     // the SSIP bit in sip.
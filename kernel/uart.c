@@ -27,9 +27,32 @@
 #define LCR 3 // line control register
 #define LSR 5 // line status register
 
+#define IER_RX_ENABLE (1<<0)
+#define IER_TX_ENABLE (1<<1)
+#define LSR_RX_READY (1<<0)   // input is waiting to be read from RHR
+#define LSR_TX_IDLE (1<<5)    // THR and the transmit FIFO are empty
+#define UART_FIFO 16          // bytes the transmit FIFO holds
+
 #define ReadReg(reg) (*(Reg(reg)))
 #define WriteReg(reg, v) (*(Reg(reg)) = (v))
 
+// the transmit output buffer, filled by uartwrite() and
+// drained into the UART, after any new kernel log output,
+// by uartstart(), which the UART's transmit-empty interrupt
+// calls.
+struct {
+  struct spinlock lock;
+#define UART_TX_BUF 512
+  char buf[UART_TX_BUF];
+  uint w; // write next to buf[w % UART_TX_BUF]
+  uint r; // read next from buf[r % UART_TX_BUF]
+  int waiting; // uartwrite()s asleep for room
+} tx;
+
+extern volatile int panicked; // from printf.c
+
+static void uartstart(void);
+
 void
 uartinit(void)
 {
@@ -52,18 +75,108 @@ uartinit(void)
   // reset and enable FIFOs.
   WriteReg(FCR, 0x07);
 
-  // enable receive interrupts.
-  WriteReg(IER, 0x01);
+  // enable transmit and receive interrupts.
+  WriteReg(IER, IER_TX_ENABLE | IER_RX_ENABLE);
+
+  initlock(&tx.lock, "uart");
 }
 
-// write one output character to the UART.
+// add n bytes from src to the transmit buffer, sleeping until
+// there is room.  if n fits in the buffer, it waits for room for
+// all n first, so that the bytes go in together rather than
+// interleaved with another writer's.  returns the number added,
+// less than n only if the process was killed.  called from
+// write() system calls; not for use in interrupts.
+int
+uartwrite(char *src, int n)
+{
+  int i, want;
+
+  acquire(&tx.lock);
+  want = n <= UART_TX_BUF ? n : 1;
+  for(i = 0; i < n; i++){
+    while(tx.r + UART_TX_BUF - tx.w < want){
+      // not enough room.  wait for uartstart() to make some.
+      uartstart();
+      if(myproc()->killed){
+        release(&tx.lock);
+        return i;
+      }
+      tx.waiting++;
+      sleep(&tx.r, &tx.lock);
+      tx.waiting--;
+    }
+    tx.buf[tx.w++ % UART_TX_BUF] = src[i];
+    want = 1;
+  }
+  uartstart();
+  release(&tx.lock);
+  return n;
+}
+
+// write one output character to the UART, waiting for it to
+// be ready instead of using the transmit buffer.  for kernel
+// printf() and for echoing input, which may not sleep.
 void
-uartputc(int c)
+uartputc_sync(int c)
 {
+  push_off();
+
+  if(panicked){
+    for(;;)
+      ;
+  }
+
   // wait for Transmit Holding Empty to be set in LSR.
-  while((ReadReg(LSR) & (1 << 5)) == 0)
+  while((ReadReg(LSR) & LSR_TX_IDLE) == 0)
     ;
   WriteReg(THR, c);
+
+  pop_off();
+}
+
+// if the UART is idle, give it as many bytes as its FIFO
+// holds: kernel log output first, then the transmit buffer.
+// the transmit-empty interrupt brings us back for more.
+// caller must hold tx.lock.
+static void
+uartstart(void)
+{
+  char buf[UART_FIFO];
+  int i, n;
+  uint r0;
+
+  if((ReadReg(LSR) & LSR_TX_IDLE) == 0)
+    return;
+  n = klogconsole(buf, UART_FIFO);
+  r0 = tx.r;
+  while(n < UART_FIFO && tx.r != tx.w)
+    buf[n++] = tx.buf[tx.r++ % UART_TX_BUF];
+  if(n == 0){
+    // nothing to send; reading ISR acknowledges the
+    // transmit-empty interrupt.
+    ReadReg(ISR);
+    return;
+  }
+  for(i = 0; i < n; i++)
+    WriteReg(THR, buf[i]);
+
+  // wake uartwrite()s waiting for space, if this made some.
+  // most calls send only kernel log output, or nobody waits,
+  // so don't pay for wakeup()'s scan of every process then.
+  if(tx.waiting && tx.r != r0)
+    wakeup(&tx.r);
+}
+
+// send output, if the UART is idle and there is any.
+// for printf(), which can't wait for the next interrupt
+// when the UART has nothing else to do.
+void
+uartkick(void)
+{
+  acquire(&tx.lock);
+  uartstart();
+  release(&tx.lock);
 }
 
 // read one input character from the UART.
@@ -71,7 +184,7 @@ uartputc(int c)
 int
 uartgetc(void)
 {
-  if(ReadReg(LSR) & 0x01){
+  if(ReadReg(LSR) & LSR_RX_READY){
     // input data is ready.
     return ReadReg(RHR);
   } else {
@@ -79,14 +192,19 @@ uartgetc(void)
   }
 }
 
-// trap.c calls here when the uart interrupts.
+// trap.c calls here when the uart interrupts, because input
+// has arrived, or the UART is ready for more output, or both.
 void
 uartintr(void)
 {
+  // read and process incoming characters.
   while(1){
     int c = uartgetc();
     if(c == -1)
       break;
     consoleintr(c);
   }
+
+  // send buffered characters.
+  uartkick();
 }
@@ -0,0 +1,15 @@
+// One buffer of a readv() or writev().
+struct iovec {
+  void *base;
+  int len;
+};
+
+#define MAXIOV 32  // most buffers in one readv() or writev()
+
+// One system call of a sysbatch(): the kernel runs
+// syscall num with arguments arg[] and sets ret.
+struct sysreq {
+  int num;
+  uint64 arg[6];
+  uint64 ret;
+};
@@ -16,10 +16,17 @@
 #include "fs.h"
 #include "buf.h"
 #include "virtio.h"
+#include "trace.h"
 
 // the address of virtio mmio register r.
 #define R(n, r) ((volatile uint32 *)(VIRTION(n) + (r)))
 
+struct virtio_blk_outhdr {
+  uint32 type;
+  uint32 reserved;
+  uint64 sector;
+};
+
 struct disk {
   // memory for virtio descriptors &c for queue 0.
   // this is a global instead of allocated because it has
@@ -43,6 +50,10 @@ struct disk {
     char status;
   } info[NUM];
 
+  // the type/reserved/sector header of each request,
+  // also indexed by first descriptor index of chain.
+  struct virtio_blk_outhdr ops[NUM];
+
   // initialized?
   int init;
 
@@ -177,46 +188,32 @@ alloc3_desc(int n, int *idx)
   return 0;
 }
 
-void
-virtio_disk_rw(int n, struct buf *b, int write)
+// Start the request to read or write b whose three
+// descriptors alloc3_desc() put in idx.
+// Caller must hold disk[n].vdisk_lock.
+static void
+virtio_disk_start(int n, struct buf *b, int write, int *idx)
 {
   uint64 sector = b->blockno * (BSIZE / 512);
 
-  acquire(&disk[n].vdisk_lock);
-
   // the spec says that legacy block operations use three
   // descriptors: one for type/reserved/sector, one for
   // the data, one for a 1-byte status result.
 
-  // allocate the three descriptors.
-  int idx[3];
-  while(1){
-    if(alloc3_desc(n, idx) == 0) {
-      break;
-    }
-    sleep(&disk[n].free[0], &disk[n].vdisk_lock);
-  }
-  
   // format the three descriptors.
   // qemu's virtio-blk.c reads them.
 
-  struct virtio_blk_outhdr {
-    uint32 type;
-    uint32 reserved;
-    uint64 sector;
-  } buf0;
+  struct virtio_blk_outhdr *buf0 = &disk[n].ops[idx[0]];
 
   if(write)
-    buf0.type = VIRTIO_BLK_T_OUT; // write the disk
+    buf0->type = VIRTIO_BLK_T_OUT; // write the disk
   else
-    buf0.type = VIRTIO_BLK_T_IN; // read the disk
-  buf0.reserved = 0;
-  buf0.sector = sector;
-
-  // buf0 is on a kernel stack, which is not direct mapped,
-  // thus the call to kvmpa().
-  disk[n].desc[idx[0]].addr = (uint64) kvmpa((uint64) &buf0);
-  disk[n].desc[idx[0]].len = sizeof(buf0);
+    buf0->type = VIRTIO_BLK_T_IN; // read the disk
+  buf0->reserved = 0;
+  buf0->sector = sector;
+
+  disk[n].desc[idx[0]].addr = (uint64) buf0;
+  disk[n].desc[idx[0]].len = sizeof(*buf0);
   disk[n].desc[idx[0]].flags = VRING_DESC_F_NEXT;
   disk[n].desc[idx[0]].next = idx[1];
 
@@ -248,18 +245,54 @@ virtio_disk_rw(int n, struct buf *b, int write)
   disk[n].avail[1] = disk[n].avail[1] + 1;
 
   *R(n, VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+  trace(TR_DISKSTART, n, b->blockno, write);
+}
 
-  // Wait for virtio_disk_intr() to say request has finished.
-  while(b->disk == 1) {
-    sleep(b, &disk[n].vdisk_lock);
-  }
+// Read or write the nbuf bufs in bufs, handing the device
+// as many requests at once as there are free descriptors for.
+void
+virtio_disk_rwv(int n, struct buf **bufs, int nbuf, int write)
+{
+  int idx[3], first[NUM/3];
+  int i, j, k;
+
+  acquire(&disk[n].vdisk_lock);
+
+  for(i = 0; i < nbuf; i += k){
+    // start requests until out of descriptors.  wait for
+    // more only if none of ours are in flight, since another
+    // process may be holding some and waiting for more too.
+    k = 0;
+    while(i + k < nbuf){
+      if(alloc3_desc(n, idx) < 0){
+        if(k > 0)
+          break;
+        sleep(&disk[n].free[0], &disk[n].vdisk_lock);
+        continue;
+      }
+      virtio_disk_start(n, bufs[i+k], write, idx);
+      first[k++] = idx[0];
+    }
 
-  disk[n].info[idx[0]].b = 0;
-  free_chain(n, idx[0]);
+    // Wait for virtio_disk_intr() to say the requests have finished.
+    for(j = 0; j < k; j++){
+      while(bufs[i+j]->disk == 1) {
+        sleep(bufs[i+j], &disk[n].vdisk_lock);
+      }
+      disk[n].info[first[j]].b = 0;
+      free_chain(n, first[j]);
+    }
+  }
 
   release(&disk[n].vdisk_lock);
 }
 
+void
+virtio_disk_rw(int n, struct buf *b, int write)
+{
+  virtio_disk_rwv(n, &b, 1, write);
+}
+
 void
 virtio_disk_intr(int n)
 {
@@ -272,6 +305,7 @@ virtio_disk_intr(int n)
       panic("virtio_disk_intr status");
     
     disk[n].info[id].b->disk = 0;   // disk is done with buf
+    trace(TR_DISKDONE, n, disk[n].info[id].b->blockno, 0);
     wakeup(disk[n].info[id].b);
 
     disk[n].used_idx = (disk[n].used_idx + 1) % NUM;
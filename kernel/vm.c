@@ -5,6 +5,8 @@
 #include "riscv.h"
 #include "defs.h"
 #include "fs.h"
+#include "spinlock.h"
+#include "proc.h"
 
 /*
  * the kernel's page table.
@@ -54,6 +56,53 @@ kvminit()
   kvmmap(TRAMPOLINE, (uint64)trampoline, PGSIZE, PTE_R | PTE_X);
 }
 
+// Create a kernel page table for a process.  It shares every
+// mapping of kernel_pagetable except the lowest gigabyte, whose
+// level-1 page is private so that the process's user memory
+// (which must lie below PLIC) can be mirrored into it by
+// kvmmirror().  The shared level-1 entries from PLIC upward
+// still point at the kernel's own page-table pages.  CLINT is
+// left out: besides machine mode (start.c, timervec), only the
+// scheduler, on the kernel page table, and timerpoke(), which
+// switches to it, touch it.
+// Returns 0 if out of memory.
+pagetable_t
+kvmcreate()
+{
+  pagetable_t kpagetable, l1, kl1;
+
+  if((kpagetable = (pagetable_t) kalloc()) == 0)
+    return 0;
+  if((l1 = (pagetable_t) kalloc()) == 0){
+    kfree(kpagetable);
+    return 0;
+  }
+  memmove(kpagetable, kernel_pagetable, PGSIZE);
+  memset(l1, 0, PGSIZE);
+  kl1 = (pagetable_t) PTE2PA(kernel_pagetable[0]);
+  for(int i = PX(1, PLIC); i < 512; i++)
+    l1[i] = kl1[i];
+  kpagetable[0] = PA2PTE(l1) | PTE_V;
+  return kpagetable;
+}
+
+// Free a page table made by kvmcreate(), including the
+// page-table pages that held mirrored user mappings.
+// The mirrored user pages themselves belong to the
+// user page table and are not freed here.
+void
+kvmfree(pagetable_t kpagetable)
+{
+  pagetable_t l1 = (pagetable_t) PTE2PA(kpagetable[0]);
+
+  for(int i = 0; i < PX(1, PLIC); i++){
+    if(l1[i] & PTE_V)
+      kfree((void*)PTE2PA(l1[i]));
+  }
+  kfree((void*)l1);
+  kfree((void*)kpagetable);
+}
+
 // Switch h/w page table register to the kernel's page table,
 // and enable paging.
 void
@@ -171,6 +220,51 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
   return 0;
 }
 
+// Copy the user mappings for [oldsz, newsz) from pagetable into
+// the process kernel page table kpagetable, without PTE_U, so
+// that the kernel can dereference those user addresses directly.
+// Pages that user code can't touch either (exec()'s stack guard)
+// are left out.  Page boundaries are rounded like uvmalloc().
+// Returns 0 on success, -1 if a page-table page couldn't be
+// allocated or newsz reaches into the shared-memory slots at
+// SHMBASE, which are never mirrored.
+int
+kvmmirror(pagetable_t pagetable, pagetable_t kpagetable, uint64 oldsz, uint64 newsz)
+{
+  pte_t *pte, *kpte;
+  uint64 a;
+
+  if(newsz > SHMBASE)
+    return -1;
+  for(a = PGROUNDUP(oldsz); a < newsz; a += PGSIZE){
+    if((pte = walk(pagetable, a, 0)) == 0 || (*pte & PTE_V) == 0)
+      panic("kvmmirror: not mapped");
+    if((kpte = walk(kpagetable, a, 1)) == 0)
+      return -1;
+    *kpte = (*pte & PTE_U) ? *pte & ~PTE_U : 0;
+  }
+  sfence_vma();
+  return 0;
+}
+
+// Remove mirrored user mappings to bring the mirror from oldsz
+// down to newsz, rounding like uvmdealloc().  The physical pages
+// belong to the user page table and are not freed.
+void
+kvmunmirror(pagetable_t kpagetable, uint64 oldsz, uint64 newsz)
+{
+  pte_t *pte;
+  uint64 a;
+
+  if(newsz >= oldsz)
+    return;
+  for(a = PGROUNDDOWN(newsz); a < oldsz; a += PGSIZE){
+    if((pte = walk(kpagetable, a, 0)) != 0)
+      *pte = 0;
+  }
+  sfence_vma();
+}
+
 // Remove mappings from a page table. The mappings in
 // the given range must exist. Optionally free the
 // physical memory.
@@ -299,7 +393,8 @@ freewalk(pagetable_t pagetable)
 void
 uvmfree(pagetable_t pagetable, uint64 sz)
 {
-  uvmunmap(pagetable, 0, sz, 1);
+  if(sz > 0)
+    uvmunmap(pagetable, 0, sz, 1);
   freewalk(pagetable);
 }
 
@@ -339,6 +434,29 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
   return -1;
 }
 
+// Replace the physical page mapped at the writable user address va
+// with the page at pa, in both pagetable and its kernel mirror
+// kpagetable.  The caller takes ownership of the old page.
+// Returns the old page's physical address, or 0 if va isn't a
+// mirrored, writable user page.
+uint64
+uvmswap(pagetable_t pagetable, pagetable_t kpagetable, uint64 va, uint64 pa)
+{
+  pte_t *pte, *kpte;
+  uint64 old;
+
+  if((pte = walk(pagetable, va, 0)) == 0 ||
+     (*pte & (PTE_V|PTE_U|PTE_W)) != (PTE_V|PTE_U|PTE_W))
+    return 0;
+  if((kpte = walk(kpagetable, va, 0)) == 0 || (*kpte & PTE_V) == 0)
+    return 0;
+  old = PTE2PA(*pte);
+  *pte = PA2PTE(pa) | PTE_FLAGS(*pte);
+  *kpte = PA2PTE(pa) | PTE_FLAGS(*kpte);
+  sfence_vma();
+  return old;
+}
+
 // mark a PTE invalid for user access.
 // used by exec for the user stack guard page.
 void
@@ -352,13 +470,41 @@ uvmclear(pagetable_t pagetable, uint64 va)
   *pte &= ~PTE_U;
 }
 
+// The end of the current process's memory that the kernel page
+// table mirrors at va (see kvmmirror()), which is va itself if
+// va isn't mirrored: below p->sz, but not the stack guard page.
+static uint64
+mirrorend(struct proc *p, uint64 va)
+{
+  if(va >= p->sz)
+    return va;
+  if(p->guard){
+    if(va >= p->guard && va < p->guard + PGSIZE)
+      return va;
+    if(va < p->guard)
+      return p->guard;
+  }
+  return p->sz;
+}
+
 // Copy from kernel to user.
 // Copy len bytes from src to virtual address dstva in a given page table.
+// If pagetable is the current process's, memory below p->sz is
+// mirrored in the kernel page table and a bounds check plus memmove
+// suffices; anything else (e.g. shared-memory segments, or the
+// stack guard page, which fails) is walked.
 // Return 0 on success, -1 on error.
 int
 copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
   uint64 n, va0, pa0;
+  struct proc *p = myproc();
+
+  if(p && pagetable == p->pagetable &&
+     dstva + len <= mirrorend(p, dstva) && dstva + len >= dstva){
+    memmove((void *)dstva, src, len);
+    return 0;
+  }
 
   while(len > 0){
     va0 = (uint)PGROUNDDOWN(dstva);
@@ -379,11 +525,20 @@ copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 
 // Copy from user to kernel.
 // Copy len bytes to dst from virtual address srcva in a given page table.
+// As in copyout(), the current process's mirrored memory is
+// read directly.
 // Return 0 on success, -1 on error.
 int
 copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 {
   uint64 n, va0, pa0;
+  struct proc *p = myproc();
+
+  if(p && pagetable == p->pagetable &&
+     srcva + len <= mirrorend(p, srcva) && srcva + len >= srcva){
+    memmove(dst, (void *)srcva, len);
+    return 0;
+  }
 
   while(len > 0){
     va0 = (uint)PGROUNDDOWN(srcva);
@@ -409,8 +564,18 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 int
 copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 {
-  uint64 n, va0, pa0;
+  uint64 n, va0, pa0, end;
   int got_null = 0;
+  struct proc *p = myproc();
+
+  if(p && pagetable == p->pagetable){
+    end = mirrorend(p, srcva);
+    for(; max > 0 && srcva < end; max--, srcva++, dst++){
+      *dst = *(char *)srcva;
+      if(*dst == '\0')
+        return 0;
+    }
+  }
 
   while(got_null == 0 && max > 0){
     va0 = (uint)PGROUNDDOWN(srcva);
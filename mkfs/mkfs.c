@@ -22,7 +22,7 @@
 
 int nbitmap = FSSIZE/(BSIZE*8) + 1;
 int ninodeblocks = NINODES / IPB + 1;
-int nlog = LOGSIZE;
+int nlog = 2*NBUF;
 int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
 int nblocks;  // Number of data blocks
 
@@ -40,6 +40,7 @@ void rinode(uint inum, struct dinode *ip);
 void rsect(uint sec, void *buf);
 uint ialloc(ushort type);
 void iappend(uint inum, void *p, int n);
+void wdir(uint inum, struct dirent *de, int n);
 
 // convert to intel byte order
 ushort
@@ -69,15 +70,22 @@ main(int argc, char *argv[])
 {
   int i, cc, fd;
   uint rootino, inum, off;
-  struct dirent de;
+  struct dirent de[NINODES];
+  int nde, journal = 0;
   char buf[BSIZE];
   struct dinode din;
 
 
   static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
 
+  if(argc > 1 && strcmp(argv[1], "-j") == 0){
+    // journal file data too, not just metadata.
+    journal = 1;
+    argc--;
+    argv++;
+  }
   if(argc < 2){
-    fprintf(stderr, "Usage: mkfs fs.img files...\n");
+    fprintf(stderr, "Usage: mkfs [-j] fs.img files...\n");
     exit(1);
   }
 
@@ -102,6 +110,7 @@ main(int argc, char *argv[])
   sb.logstart = xint(2);
   sb.inodestart = xint(2+nlog);
   sb.bmapstart = xint(2+nlog+ninodeblocks);
+  sb.flags = xint(journal ? 0 : FSORDERED);
 
   printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d\n",
          nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE);
@@ -118,15 +127,12 @@ main(int argc, char *argv[])
   rootino = ialloc(T_DIR);
   assert(rootino == ROOTINO);
 
-  bzero(&de, sizeof(de));
-  de.inum = xshort(rootino);
-  strcpy(de.name, ".");
-  iappend(rootino, &de, sizeof(de));
-
-  bzero(&de, sizeof(de));
-  de.inum = xshort(rootino);
-  strcpy(de.name, "..");
-  iappend(rootino, &de, sizeof(de));
+  bzero(de, sizeof(de));
+  de[0].inum = xshort(rootino);
+  strcpy(de[0].name, ".");
+  de[1].inum = xshort(rootino);
+  strcpy(de[1].name, "..");
+  nde = 2;
 
   for(i = 2; i < argc; i++){
     // get rid of "user/"
@@ -152,10 +158,10 @@ main(int argc, char *argv[])
 
     inum = ialloc(T_FILE);
 
-    bzero(&de, sizeof(de));
-    de.inum = xshort(inum);
-    strncpy(de.name, shortname, DIRSIZ);
-    iappend(rootino, &de, sizeof(de));
+    assert(nde < NINODES);
+    de[nde].inum = xshort(inum);
+    strncpy(de[nde].name, shortname, DIRSIZ);
+    nde++;
 
     while((cc = read(fd, buf, sizeof(buf))) > 0)
       iappend(inum, buf, cc);
@@ -163,12 +169,16 @@ main(int argc, char *argv[])
     close(fd);
   }
 
+  wdir(rootino, de, nde);
+
   // fix size of root inode dir
   rinode(rootino, &din);
   off = xint(din.size);
-  off = ((off/BSIZE) + 1) * BSIZE;
-  din.size = xint(off);
-  winode(rootino, &din);
+  if(off % BSIZE){
+    off = ((off/BSIZE) + 1) * BSIZE;
+    din.size = xint(off);
+    winode(rootino, &din);
+  }
 
   balloc(freeblock);
 
@@ -303,3 +313,78 @@ iappend(uint inum, void *xp, int n)
   din.size = xint(off);
   winode(inum, &din);
 }
+
+// Must match dirhash() in kernel/fs.c.
+uint
+dirhash(char *name)
+{
+  uint h = 2166136261;
+  int i;
+
+  for(i = 0; i < DIRSIZ && name[i]; i++){
+    h ^= (uchar)name[i];
+    h *= 16777619;
+  }
+  return h;
+}
+
+int
+dehashcmp(const void *a, const void *b)
+{
+  uint ha = dirhash(((struct dirent*)a)->name);
+  uint hb = dirhash(((struct dirent*)b)->name);
+
+  return ha < hb ? -1 : ha > hb;
+}
+
+// Write the n entries de[], starting with "." and "..", as the
+// contents of directory inum: a plain list if they fit in one
+// block, otherwise indexed the way the kernel's dirlink() does
+// it (see struct dxentry in kernel/fs.h).  Leaves are filled
+// only to 3/4 to leave room for new names.
+void
+wdir(uint inum, struct dirent *de, int n)
+{
+  char buf[BSIZE];
+  struct dxentry *dx;
+  int i, j, nleaf, fill;
+  uint h;
+
+  if(n <= DPB){
+    iappend(inum, de, n * sizeof(*de));
+    return;
+  }
+
+  qsort(de + 2, n - 2, sizeof(*de), dehashcmp);
+
+  bzero(buf, BSIZE);
+  memmove(buf, de, 2 * sizeof(*de));
+  iappend(inum, buf, BSIZE);
+
+  // lay out the leaves, never splitting equal hashes.
+  bzero(buf, BSIZE);
+  dx = (struct dxentry*)buf;
+  nleaf = 0;
+  fill = DPB * 3 / 4;
+  for(i = 2; i < n; i = j){
+    for(j = i + 1; j < n && (j - i < fill || dirhash(de[j].name) == dirhash(de[j-1].name)); j++)
+      ;
+    assert(j - i <= DPB);
+    nleaf++;
+    assert(nleaf < DXPB);
+    h = nleaf == 1 ? 0 : dirhash(de[i].name);
+    dx[nleaf].hash = xint(h);
+    dx[nleaf].block = xint(nleaf + 1);
+  }
+  dx[0].hash = xint(DXMAGIC);
+  dx[0].block = xint(nleaf);
+  iappend(inum, buf, BSIZE);
+
+  for(i = 2; i < n; i = j){
+    for(j = i + 1; j < n && (j - i < fill || dirhash(de[j].name) == dirhash(de[j-1].name)); j++)
+      ;
+    bzero(buf, BSIZE);
+    memmove(buf, de + i, (j - i) * sizeof(*de));
+    iappend(inum, buf, BSIZE);
+  }
+}
@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+#
+# Turn the samples that user/prof.c prints into folded stacks,
+# one line per distinct stack with its sample count, ready for
+# flamegraph.pl:
+#
+#   ./profsym.py console.log | flamegraph.pl > prof.svg
+#
+# Kernel pcs are looked up in kernel/kernel.sym, user pcs in
+# user/<name>.sym, the symbol tables the Makefile writes next
+# to each binary.  Kernel frames get a _[k] suffix, which
+# flamegraph.pl --color=java shows in their own color.
+#
+
+import bisect
+import collections
+import fileinput
+import os
+import sys
+
+TOP = os.path.dirname(os.path.abspath(__file__))
+
+class Symbols:
+    def __init__(self, path):
+        syms = []
+        try:
+            with open(path) as f:
+                for line in f:
+                    fields = line.split()
+                    if len(fields) != 2:
+                        continue
+                    addr, name = fields
+                    # skip section names and source file names.
+                    if name.startswith('.') or name.endswith(('.c', '.S')):
+                        continue
+                    syms.append((int(addr, 16), name))
+        except (OSError, ValueError):
+            pass
+        syms.sort()
+        self.addrs = [a for a, _ in syms]
+        self.names = [n for _, n in syms]
+
+    def lookup(self, pc):
+        i = bisect.bisect_right(self.addrs, pc) - 1
+        if i < 0:
+            return '%#x' % pc
+        return self.names[i]
+
+def main():
+    kernel = Symbols(os.path.join(TOP, 'kernel', 'kernel.sym'))
+    user = {}
+    stacks = collections.Counter()
+    lost = 0
+
+    for line in fileinput.input():
+        i = line.find('@prof ')
+        if i < 0:
+            continue
+        fields = line[i:].split()
+        try:
+            if fields[1] == 'lost':
+                lost += int(fields[2])
+                continue
+            name = fields[2]
+            nkernel = int(fields[3])
+            pcs = [int(pc, 16) for pc in fields[4:]]
+        except (IndexError, ValueError):
+            continue  # mangled by other console output
+        if name not in user:
+            user[name] = Symbols(os.path.join(TOP, 'user', name + '.sym'))
+
+        frames = []
+        for j, pc in enumerate(pcs):
+            # all but the first are return addresses; look
+            # up the call instruction instead.
+            if j > 0:
+                pc -= 1
+            if j < nkernel:
+                frames.append(kernel.lookup(pc) + '_[k]')
+            else:
+                frames.append(user[name].lookup(pc))
+        frames.reverse()
+        stacks[';'.join([name] + frames)] += 1
+
+    for stack, n in sorted(stacks.items()):
+        print(stack, n)
+    if lost:
+        print('profsym: %d samples lost' % lost, file=sys.stderr)
+
+if __name__ == '__main__':
+    main()
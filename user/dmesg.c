@@ -0,0 +1,25 @@
+//
+// dmesg
+//
+// Print the kernel's messages, as many of them as the kernel
+// log still holds (the last KLOGSIZE bytes).
+//
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "user/user.h"
+
+char buf[KLOGSIZE];
+
+int
+main(int argc, char *argv[])
+{
+  int n;
+
+  if((n = dmesg(buf, sizeof(buf))) < 0){
+    fprintf(2, "dmesg: failed\n");
+    exit(1);
+  }
+  write(1, buf, n);
+  exit(0);
+}
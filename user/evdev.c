@@ -0,0 +1,75 @@
+//
+// Helpers for programs that read an event device, such as the
+// profiler and tracing (see kernel/evdev.c).
+//
+
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+#include "user/evdev.h"
+
+// Open the event device at path, making it with major if it
+// doesn't exist, and turn it on.  Returns an fd, or -1.
+int
+evstart(char *path, int major)
+{
+  int fd;
+
+  if((fd = open(path, O_RDWR)) < 0){
+    mknod(path, major, 0);
+    fd = open(path, O_RDWR);
+  }
+  if(fd < 0)
+    return -1;
+  if(write(fd, "1", 1) != 1){
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Run the command argv while the caller reads the device fd,
+// then turn the device off so that the caller's reads end.
+// A child waits for a grandchild that runs the command, so the
+// caller should wait() once it has read everything.  who names
+// the caller in error messages.  Returns 0, or -1 if fork fails,
+// having turned the device off.
+int
+evrun(int fd, char **argv, char *who)
+{
+  int pid;
+
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "%s: fork failed\n", who);
+    write(fd, "0", 1);
+    return -1;
+  }
+  if(pid == 0){
+    pid = fork();
+    if(pid == 0){
+      close(fd);
+      exec(argv[0], argv);
+      fprintf(2, "%s: exec %s failed\n", who, argv[0]);
+      exit(1);
+    }
+    if(pid > 0)
+      wait(0);
+    write(fd, "0", 1);
+    exit(0);
+  }
+  return 0;
+}
+
+// Read records of size bytes from the device fd into buf, which
+// holds n bytes, and call fn on each, until the device is off
+// and drained.
+void
+evdrain(int fd, void *buf, int n, int size, void (*fn)(void*))
+{
+  int got, i;
+
+  while((got = read(fd, buf, n - n % size)) > 0)
+    for(i = 0; i + size <= got; i += size)
+      fn((char*)buf + i);
+}
@@ -0,0 +1,5 @@
+// helpers for programs that read an event device (see
+// kernel/evdev.c), such as prof and trace.
+int evstart(char*, int);
+int evrun(int, char**, char*);
+void evdrain(int, void*, int, int, void (*)(void*));
@@ -0,0 +1,147 @@
+//
+// tests for futex_wait/futex_wake, using shared-memory
+// segments to share the futex words between processes.
+//
+
+#include "kernel/types.h"
+#include "user/user.h"
+
+#define NCHILD 4
+#define NITER 500
+
+struct shared {
+  int flag;
+  int lock;     // 0 unlocked, 1 locked, 2 locked with waiters
+  int counter;
+};
+
+// a mutex in the style of Drepper's "Futexes Are Tricky".
+void
+mutex_lock(int *m)
+{
+  int c;
+
+  if((c = __sync_val_compare_and_swap(m, 0, 1)) == 0)
+    return;
+  if(c != 2)
+    c = __sync_lock_test_and_set(m, 2);
+  while(c != 0){
+    futex_wait(m, 2);
+    c = __sync_lock_test_and_set(m, 2);
+  }
+}
+
+void
+mutex_unlock(int *m)
+{
+  if(__sync_fetch_and_sub(m, 1) != 1){
+    *m = 0;
+    __sync_synchronize();
+    futex_wake(m, 1);
+  }
+}
+
+// a child blocks in futex_wait until the parent
+// changes the word and wakes it.
+void
+waketest(struct shared *s)
+{
+  int pid, xstatus;
+
+  printf("wake: ");
+
+  if(futex_wait(&s->flag, 1) != -1){
+    printf("futex_wait with stale value did not return -1\n");
+    exit(-1);
+  }
+  if(futex_wait((int*)((char*)&s->flag + 1), 0) != -1){
+    printf("misaligned futex_wait did not fail\n");
+    exit(-1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("fork failed\n");
+    exit(-1);
+  }
+  if(pid == 0){
+    while(s->flag == 0)
+      futex_wait(&s->flag, 0);
+    exit(0);
+  }
+
+  sleep(5);
+  s->flag = 1;
+  __sync_synchronize();
+  futex_wake(&s->flag, 1);
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("child failed\n");
+    exit(-1);
+  }
+  if(futex_wake(&s->flag, 1) != 0){
+    printf("futex_wake found a waiter that should be gone\n");
+    exit(-1);
+  }
+
+  printf("ok\n");
+}
+
+// NCHILD processes increment a shared counter under
+// a futex-based mutex.
+void
+mutextest(struct shared *s)
+{
+  int i, pid, xstatus;
+
+  printf("mutex: ");
+
+  for(i = 0; i < NCHILD; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("fork failed\n");
+      exit(-1);
+    }
+    if(pid == 0){
+      for(int k = 0; k < NITER; k++){
+        mutex_lock(&s->lock);
+        int c = s->counter;
+        if(k % 50 == 0)
+          sleep(1);
+        s->counter = c + 1;
+        mutex_unlock(&s->lock);
+      }
+      exit(0);
+    }
+  }
+  for(i = 0; i < NCHILD; i++){
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("child failed\n");
+      exit(-1);
+    }
+  }
+
+  if(s->counter != NCHILD*NITER){
+    printf("counter %d, expected %d\n", s->counter, NCHILD*NITER);
+    exit(-1);
+  }
+
+  printf("ok\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct shared *s;
+
+  s = shmat(7, 4096);
+  if(s == (struct shared*)-1){
+    printf("shmat failed\n");
+    exit(-1);
+  }
+  waketest(s);
+  mutextest(s);
+  printf("ALL FUTEX TESTS PASSED\n");
+  exit(0);
+}
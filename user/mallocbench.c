@@ -0,0 +1,118 @@
+//
+// malloc/free microbenchmark.
+//
+// Times a few allocation patterns in ticks, checks that blocks
+// keep their contents, and that freeing large blocks gives
+// memory back to the kernel.
+//
+
+#include "kernel/types.h"
+#include "user/user.h"
+
+#define NSLOT 1000
+#define NITER 200000
+
+char *slot[NSLOT];
+uint slotsz[NSLOT];
+
+static uint seed = 1;
+
+uint
+rnd(void)
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 8;
+}
+
+// allocate and free one size over and over.
+void
+fixed(uint n)
+{
+  int t0, i;
+  char *p;
+
+  t0 = uptime();
+  for(i = 0; i < NITER; i++){
+    if((p = malloc(n)) == 0){
+      printf("fixed: out of memory\n");
+      exit(1);
+    }
+    p[0] = i;
+    free(p);
+  }
+  printf("fixed %d bytes: %d ops in %d ticks\n", n, 2*NITER, uptime() - t0);
+}
+
+// random sizes, freed in random order, with contents checked.
+void
+mixed(uint maxsz)
+{
+  int t0, i, s;
+  uint k;
+
+  t0 = uptime();
+  for(i = 0; i < NITER; i++){
+    s = rnd() % NSLOT;
+    if(slot[s]){
+      for(k = 0; k < slotsz[s]; k += 64){
+        if(slot[s][k] != (char)s){
+          printf("mixed: slot %d corrupted\n", s);
+          exit(1);
+        }
+      }
+      free(slot[s]);
+      slot[s] = 0;
+    } else {
+      slotsz[s] = 1 + rnd() % maxsz;
+      if((slot[s] = malloc(slotsz[s])) == 0){
+        printf("mixed: out of memory\n");
+        exit(1);
+      }
+      for(k = 0; k < slotsz[s]; k += 64)
+        slot[s][k] = s;
+    }
+  }
+  for(s = 0; s < NSLOT; s++){
+    free(slot[s]);
+    slot[s] = 0;
+  }
+  printf("mixed up to %d bytes: %d ops in %d ticks\n", maxsz, NITER, uptime() - t0);
+}
+
+// big blocks come from sbrk and go back to it.
+void
+big(void)
+{
+  char *top, *grown, *p[4];
+  int i;
+
+  top = sbrk(0);
+  for(i = 0; i < 4; i++){
+    if((p[i] = malloc(256*1024)) == 0){
+      printf("big: out of memory\n");
+      exit(1);
+    }
+    p[i][256*1024 - 1] = i;
+  }
+  grown = sbrk(0);
+  for(i = 3; i >= 0; i--)
+    free(p[i]);
+  printf("big: heap grew by %d bytes, kept %d after free\n",
+         (int)(grown - top), (int)(sbrk(0) - top));
+  if(sbrk(0) - top >= 256*1024){
+    printf("big: memory not returned\n");
+    exit(1);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  fixed(16);
+  fixed(200);
+  fixed(8000);
+  mixed(256);
+  mixed(4096);
+  big();
+  exit(0);
+}
@@ -7,17 +7,17 @@
 static char digits[] = "0123456789ABCDEF";
 
 static void
-putc(int fd, char c)
+putc(FILE *f, char c)
 {
-  write(fd, &c, 1);
+  fputc(c, f);
 }
 
 static void
-printint(int fd, int xx, int base, int sgn)
+printint(FILE *f, long xx, int base, int sgn)
 {
-  char buf[16];
+  char buf[24];
   int i, neg;
-  uint x;
+  uint64 x;
 
   neg = 0;
   if(sgn && xx < 0){
@@ -35,21 +35,21 @@ printint(int fd, int xx, int base, int sgn)
     buf[i++] = '-';
 
   while(--i >= 0)
-    putc(fd, buf[i]);
+    putc(f, buf[i]);
 }
 
 static void
-printptr(int fd, uint64 x) {
+printptr(FILE *f, uint64 x) {
   int i;
-  putc(fd, '0');
-  putc(fd, 'x');
+  putc(f, '0');
+  putc(f, 'x');
   for (i = 0; i < (sizeof(uint64) * 2); i++, x <<= 4)
-    putc(fd, digits[x >> (sizeof(uint64) * 8 - 4)]);
+    putc(f, digits[x >> (sizeof(uint64) * 8 - 4)]);
 }
 
-// Print to the given fd. Only understands %d, %x, %p, %s.
-void
-vprintf(int fd, const char *fmt, va_list ap)
+// Print to the given stream. Only understands %d, %l, %x, %p, %s, %c.
+static void
+vfprintf(FILE *f, const char *fmt, va_list ap)
 {
   char *s;
   int c, i, state;
@@ -61,39 +61,64 @@ vprintf(int fd, const char *fmt, va_list ap)
       if(c == '%'){
         state = '%';
       } else {
-        putc(fd, c);
+        putc(f, c);
       }
     } else if(state == '%'){
       if(c == 'd'){
-        printint(fd, va_arg(ap, int), 10, 1);
+        printint(f, va_arg(ap, int), 10, 1);
       } else if(c == 'l') {
-        printint(fd, va_arg(ap, uint64), 10, 0);
+        printint(f, va_arg(ap, uint64), 10, 0);
       } else if(c == 'x') {
-        printint(fd, va_arg(ap, int), 16, 0);
+        printint(f, va_arg(ap, uint), 16, 0);
       } else if(c == 'p') {
-        printptr(fd, va_arg(ap, uint64));
+        printptr(f, va_arg(ap, uint64));
       } else if(c == 's'){
         s = va_arg(ap, char*);
         if(s == 0)
           s = "(null)";
         while(*s != 0){
-          putc(fd, *s);
+          putc(f, *s);
           s++;
         }
       } else if(c == 'c'){
-        putc(fd, va_arg(ap, uint));
+        putc(f, va_arg(ap, uint));
       } else if(c == '%'){
-        putc(fd, c);
+        putc(f, c);
       } else {
         // Unknown % sequence.  Print it to draw attention.
-        putc(fd, '%');
-        putc(fd, c);
+        putc(f, '%');
+        putc(f, c);
       }
       state = 0;
     }
   }
 }
 
+// Print to the given fd, with a single write() if the output
+// fits in a stream buffer.  fds 1 and 2 go through stdout and
+// stderr, so that the output stays in order with theirs.
+void
+vprintf(int fd, const char *fmt, va_list ap)
+{
+  FILE tmp, *f;
+  char buf[128];
+
+  if(fd == 1)
+    f = stdout;
+  else if(fd == 2)
+    f = stderr;
+  else {
+    tmp.fd = fd;
+    tmp.flags = IOWRITE;
+    tmp.buf = buf;
+    tmp.size = sizeof(buf);
+    tmp.pos = tmp.len = 0;
+    f = &tmp;
+  }
+  vfprintf(f, fmt, ap);
+  fflush(f);
+}
+
 void
 fprintf(int fd, const char *fmt, ...)
 {
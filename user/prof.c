@@ -0,0 +1,57 @@
+//
+// prof command [arg ...]
+//
+// Run command with the sampling profiler on, printing each
+// sample on a line of its own:
+//   @prof pid name nkernel pc ...
+// innermost pc first, the first nkernel of them kernel pcs.
+// On the host, profsym.py turns a console log with these lines
+// into folded stacks for flamegraph.pl.
+//
+
+#include "kernel/types.h"
+#include "kernel/spinlock.h"
+#include "kernel/sleeplock.h"
+#include "kernel/fs.h"
+#include "kernel/file.h"
+#include "kernel/prof.h"
+#include "user/user.h"
+#include "user/evdev.h"
+
+struct profsample samples[16];
+
+void
+print(void *rec)
+{
+  struct profsample *s = rec;
+  int i;
+
+  if(s->pid < 0){
+    printf("@prof lost %d\n", (int)s->pc[0]);
+    return;
+  }
+  printf("@prof %d %s %d", s->pid, s->name, s->nkernel);
+  for(i = 0; i < s->depth; i++)
+    printf(" %p", s->pc[i]);
+  printf("\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd;
+
+  if(argc < 2){
+    fprintf(2, "usage: prof command [arg ...]\n");
+    exit(1);
+  }
+  if((fd = evstart("/prof", PROF)) < 0){
+    fprintf(2, "prof: cannot start profiler\n");
+    exit(1);
+  }
+  if(evrun(fd, argv + 1, "prof") < 0)
+    exit(1);
+  evdrain(fd, samples, sizeof(samples), sizeof(samples[0]), print);
+  wait(0);
+  exit(0);
+}
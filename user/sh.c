@@ -3,6 +3,7 @@
 #include "kernel/types.h"
 #include "user/user.h"
 #include "kernel/fcntl.h"
+#include "kernel/stat.h"
 
 // Parsed command representation
 #define EXEC  1
@@ -145,6 +146,7 @@ int
 main(void)
 {
   static char buf[100];
+  struct stat st;
   int fd;
 
   // Ensure that three file descriptors are open.
@@ -155,6 +157,12 @@ main(void)
     }
   }
 
+  // Commands may read the rest of fd 0 themselves, so don't
+  // read ahead of them, unless it's the console, whose reads
+  // stop at the end of a line anyway.
+  if(fstat(0, &st) < 0 || st.type != T_DEVICE)
+    setvbuf(stdin, 0, _IONBF, 0);
+
   // Read and run input commands.
   while(getcmd(buf, sizeof(buf)) >= 0){
     if(buf[0] == 'c' && buf[1] == 'd' && buf[2] == ' '){
@@ -0,0 +1,155 @@
+//
+// tests for shared-memory segments (shmat/shmdt).
+//
+
+#include "kernel/types.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+#define KEY 42
+#define SZ (8*4096)
+
+// a child writes into a segment it attached by key;
+// the parent sees the data through its own attachment.
+void
+sharetest()
+{
+  int *a;
+  int pid, i;
+
+  printf("share: ");
+
+  a = shmat(KEY, SZ);
+  if(a == (int*)-1){
+    printf("shmat failed\n");
+    exit(-1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("fork failed\n");
+    exit(-1);
+  }
+  if(pid == 0){
+    int *b = shmat(KEY, 0);
+    if(b == (int*)-1){
+      printf("child shmat failed\n");
+      exit(-1);
+    }
+    for(i = 0; i < SZ/sizeof(int); i++)
+      b[i] = i;
+    // the copy inherited across fork is shared too.
+    a[0] = -1;
+    shmdt(b);
+    exit(0);
+  }
+  wait(0);
+
+  if(a[0] != -1){
+    printf("inherited attachment not shared\n");
+    exit(-1);
+  }
+  for(i = 1; i < SZ/sizeof(int); i++){
+    if(a[i] != i){
+      printf("a[%d] = %d, expected %d\n", i, a[i], i);
+      exit(-1);
+    }
+  }
+
+  // the kernel can read and write a segment too.
+  int fds[2];
+  if(pipe(fds) < 0){
+    printf("pipe failed\n");
+    exit(-1);
+  }
+  if(write(fds[1], (char*)a + 4, 4) != 4 || read(fds[0], (char*)a, 4) != 4){
+    printf("pipe through segment failed\n");
+    exit(-1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  if(a[0] != 1){
+    printf("kernel copy into segment failed\n");
+    exit(-1);
+  }
+
+  if(shmdt(a) < 0){
+    printf("shmdt failed\n");
+    exit(-1);
+  }
+  if(shmdt(a) == 0){
+    printf("second shmdt succeeded\n");
+    exit(-1);
+  }
+
+  printf("ok\n");
+}
+
+// once the last attachment is gone the segment is freed:
+// attaching by key alone must fail, and a new segment
+// comes back zeroed.
+void
+freetest()
+{
+  int *a;
+
+  printf("free: ");
+
+  if(shmat(KEY, 0) != (void*)-1){
+    printf("segment survived its last detach\n");
+    exit(-1);
+  }
+
+  a = shmat(KEY, 4096);
+  if(a == (int*)-1 || a[1] != 0){
+    printf("new segment not zeroed\n");
+    exit(-1);
+  }
+  shmdt(a);
+
+  printf("ok\n");
+}
+
+// repeatedly create segments and exit without detaching,
+// which must not leak them.
+void
+exittest()
+{
+  int i, pid, xstatus;
+
+  printf("exit: ");
+
+  for(i = 0; i < 200; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("fork failed\n");
+      exit(-1);
+    }
+    if(pid == 0){
+      for(int k = 0; k < 4; k++){
+        char *p = shmat(100 + k, SZ);
+        if(p == (char*)-1){
+          printf("shmat %d failed in round %d\n", k, i);
+          exit(-1);
+        }
+        p[0] = k;
+      }
+      exit(0);
+    }
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(xstatus);
+  }
+
+  printf("ok\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  sharetest();
+  freetest();
+  exittest();
+  printf("ALL SHM TESTS PASSED\n");
+  exit(0);
+}
@@ -0,0 +1,362 @@
+//
+// Buffered I/O streams.
+//
+// A stream collects small reads and writes in a buffer and
+// turns them into one read() or write() system call per
+// BUFSIZ bytes.  stdout and stderr are line buffered: they
+// are flushed at each newline, and printf() and fprintf()
+// flush them before returning, so output still appears when
+// it is printed.  Reading stdin flushes stdout first, so that
+// a prompt shows up before the program waits for input.
+// Streams from fopen() are fully buffered.  exit() flushes
+// every open stream with fflush(0).
+// setvbuf() changes a stream's buffering or buffer before
+// its first use.  An unbuffered stream reads no more than
+// it is asked for, so a process can leave the rest of its
+// input for another one sharing the fd (sh does this).
+//
+// There is no seek, so a stream open for both reading and
+// writing can switch from reading to writing only when it
+// has used up what it read ahead; fputc() and fwrite()
+// fail otherwise.  fflush() on a reading stream throws the
+// read-ahead away.
+//
+
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+static char inbuf[BUFSIZ], outbuf[BUFSIZ], errbuf[BUFSIZ];
+
+static FILE iob[3] = {
+  { 0, IOREAD, inbuf, BUFSIZ, 0, 0, &iob[1] },
+  { 1, IOWRITE|IOLINE, outbuf, BUFSIZ, 0, 0, &iob[2] },
+  { 2, IOWRITE|IOLINE, errbuf, BUFSIZ, 0, 0, 0 },
+};
+
+FILE *stdin = &iob[0];
+FILE *stdout = &iob[1];
+FILE *stderr = &iob[2];
+
+static FILE *streams = &iob[0];  // every open stream, for fflush(0)
+
+// Make a stream for fd, with a buffer from malloc().
+FILE*
+fdopen(int fd, const char *mode)
+{
+  FILE *f;
+
+  if((f = malloc(sizeof(*f) + BUFSIZ)) == 0)
+    return 0;
+  f->fd = fd;
+  f->flags = 0;
+  if(mode[0] == 'r' || mode[1] == '+')
+    f->flags |= IOREAD;
+  if(mode[0] == 'w' || mode[1] == '+')
+    f->flags |= IOWRITE;
+  f->buf = (char*)(f + 1);
+  f->size = BUFSIZ;
+  f->pos = 0;
+  f->len = 0;
+  f->next = streams;
+  streams = f;
+  return f;
+}
+
+// Open the file path as a stream.  mode is "r" or "r+"
+// for an existing file, "w" or "w+" to create or empty one.
+FILE*
+fopen(const char *path, const char *mode)
+{
+  int fd, omode;
+  FILE *f;
+
+  if(mode[0] == 'r')
+    omode = mode[1] == '+' ? O_RDWR : O_RDONLY;
+  else if(mode[0] == 'w')
+    omode = (mode[1] == '+' ? O_RDWR : O_WRONLY) | O_CREATE;
+  else
+    return 0;
+  if((fd = open(path, omode)) < 0)
+    return 0;
+  if((mode[0] == 'w' && ftruncate(fd, 0) < 0) || (f = fdopen(fd, mode)) == 0){
+    close(fd);
+    return 0;
+  }
+  return f;
+}
+
+// Give f the buffer buf of size bytes, or one from malloc()
+// if buf is 0 and size differs from the current one, and
+// make it fully buffered (_IOFBF), line buffered (_IOLBF)
+// or unbuffered (_IONBF).  Only before f is first used.
+// Returns 0, or -1 on error.
+int
+setvbuf(FILE *f, char *buf, int mode, int size)
+{
+  if(f->pos > 0 || f->len > 0 || size < 0)
+    return -1;
+  if(mode != _IOFBF && mode != _IOLBF && mode != _IONBF)
+    return -1;
+  if(buf == 0 && size > 0 && size != f->size){
+    if((buf = malloc(size)) == 0)
+      return -1;
+    if(f->flags & IOMYBUF)
+      free(f->buf);
+    f->flags |= IOMYBUF;
+  } else if(buf){
+    if(size == 0)
+      return -1;
+    if(f->flags & IOMYBUF)
+      free(f->buf);
+    f->flags &= ~IOMYBUF;
+  }
+  if(buf){
+    f->buf = buf;
+    f->size = size;
+  }
+  f->flags &= ~(IOLINE|IONBF);
+  if(mode == _IOLBF)
+    f->flags |= IOLINE;
+  else if(mode == _IONBF)
+    f->flags |= IONBF;
+  return 0;
+}
+
+// Get f ready to write: a stream that was reading can only
+// switch once it has used up its read-ahead, since the fd's
+// offset is past it.  Returns 0, or -1 if it can't.
+static int
+towrite(FILE *f)
+{
+  if(f->len > 0){
+    if(f->pos < f->len){
+      f->flags |= IOERR;
+      return -1;
+    }
+    f->pos = f->len = 0;
+  }
+  return 0;
+}
+
+// Write out whatever f has buffered for writing, or
+// drop what it has read ahead.  If f is 0, write out every
+// open stream's output, leaving read-ahead alone.
+// Returns 0, or -1 on error.
+int
+fflush(FILE *f)
+{
+  int n, r;
+
+  if(f == 0){
+    r = 0;
+    for(f = streams; f; f = f->next)
+      if(f->pos > 0 && f->len == 0 && fflush(f) < 0)
+        r = -1;
+    return r;
+  }
+  if(f->len > 0){
+    // reading: a stream can't give back read-ahead data to its fd.
+    f->pos = f->len = 0;
+    return 0;
+  }
+  for(n = 0; n < f->pos; n += r){
+    if((r = write(f->fd, f->buf + n, f->pos - n)) <= 0){
+      f->flags |= IOERR;
+      f->pos = 0;
+      return -1;
+    }
+  }
+  f->pos = f->len = 0;
+  return 0;
+}
+
+int
+fclose(FILE *f)
+{
+  FILE **pp;
+  int r;
+
+  for(pp = &streams; *pp; pp = &(*pp)->next){
+    if(*pp == f){
+      *pp = f->next;
+      break;
+    }
+  }
+  r = fflush(f);
+  if(close(f->fd) < 0)
+    r = -1;
+  if(f->flags & IOMYBUF)
+    free(f->buf);
+  if(f < iob || f >= iob + 3)
+    free(f);
+  return r;
+}
+
+// Refill f's buffer.  Returns the number of bytes now
+// buffered, 0 at end of file or on error.
+static int
+fill(FILE *f)
+{
+  int n;
+
+  if(f == stdin)
+    fflush(stdout);
+  else if(f->pos > 0 && f->len == 0)
+    fflush(f);  // switching from writing
+  f->pos = f->len = 0;
+  if((n = read(f->fd, f->buf, (f->flags & IONBF) ? 1 : f->size)) <= 0){
+    f->flags |= n < 0 ? IOERR : IOEOF;
+    return 0;
+  }
+  f->len = n;
+  return n;
+}
+
+int
+fgetc(FILE *f)
+{
+  if(f->pos >= f->len && fill(f) == 0)
+    return -1;
+  return f->buf[f->pos++] & 0xff;
+}
+
+int
+fputc(int c, FILE *f)
+{
+  if(towrite(f) < 0)
+    return -1;
+  f->buf[f->pos++] = c;
+  if(f->pos == f->size || (f->flags & IONBF) ||
+     (c == '\n' && (f->flags & IOLINE)))
+    if(fflush(f) < 0)
+      return -1;
+  return c & 0xff;
+}
+
+int
+fputs(const char *s, FILE *f)
+{
+  int n = strlen(s);
+
+  return fwrite(s, 1, n, f) == n ? 0 : -1;
+}
+
+// Read n items of size bytes each into p.
+// Returns the number of whole items read.
+int
+fread(void *p, int size, int n, FILE *f)
+{
+  char *dst = p;
+  int tot = size * n, i, m;
+
+  for(i = 0; i < tot; i += m){
+    if(f->pos >= f->len){
+      // read big requests, and any for an unbuffered
+      // stream, straight into the caller's memory.
+      if(tot - i >= f->size || (f->flags & IONBF)){
+        if(f == stdin)
+          fflush(stdout);
+        if((m = read(f->fd, dst + i, tot - i)) <= 0){
+          f->flags |= m < 0 ? IOERR : IOEOF;
+          break;
+        }
+        continue;
+      }
+      if(fill(f) == 0)
+        break;
+    }
+    m = f->len - f->pos;
+    if(m > tot - i)
+      m = tot - i;
+    memmove(dst + i, f->buf + f->pos, m);
+    f->pos += m;
+  }
+  return size > 0 ? i / size : 0;
+}
+
+// Write n items of size bytes each from p.
+// Returns the number of whole items written.
+int
+fwrite(const void *p, int size, int n, FILE *f)
+{
+  const char *src = p;
+  int tot = size * n, i, m;
+
+  if(towrite(f) < 0)
+    return 0;
+  if(f->flags & IOLINE){
+    for(i = 0; i < tot; i++)
+      if(fputc(src[i], f) < 0)
+        break;
+    return size > 0 ? i / size : 0;
+  }
+  for(i = 0; i < tot; i += m){
+    if(f->pos == 0 && (tot - i >= f->size || (f->flags & IONBF))){
+      // write big requests, and any for an unbuffered
+      // stream, straight from the caller's memory.
+      if((m = write(f->fd, src + i, tot - i)) <= 0){
+        f->flags |= IOERR;
+        break;
+      }
+      continue;
+    }
+    m = f->size - f->pos;
+    if(m > tot - i)
+      m = tot - i;
+    memmove(f->buf + f->pos, src + i, m);
+    f->pos += m;
+    if(f->pos == f->size && fflush(f) < 0)
+      break;
+  }
+  return size > 0 ? i / size : 0;
+}
+
+// Read a line, including its newline, into buf,
+// storing at most max-1 characters and a nul.
+// Returns buf, or 0 if nothing was read.
+char*
+fgets(char *buf, int max, FILE *f)
+{
+  int i, c;
+
+  for(i = 0; i + 1 < max; ){
+    if((c = fgetc(f)) < 0)
+      break;
+    buf[i++] = c;
+    if(c == '\n')
+      break;
+  }
+  buf[i] = '\0';
+  return i > 0 ? buf : 0;
+}
+
+int
+feof(FILE *f)
+{
+  return (f->flags & IOEOF) != 0;
+}
+
+int
+ferror(FILE *f)
+{
+  return (f->flags & IOERR) != 0;
+}
+
+// Read a line from stdin, stopping after a newline or
+// carriage return.
+char*
+gets(char *buf, int max)
+{
+  int i, c;
+
+  for(i=0; i+1 < max; ){
+    if((c = fgetc(stdin)) < 0)
+      break;
+    buf[i++] = c;
+    if(c == '\n' || c == '\r')
+      break;
+  }
+  buf[i] = '\0';
+  return buf;
+}
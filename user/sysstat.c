@@ -0,0 +1,141 @@
+//
+// sysstat              system calls made since boot
+// sysstat -p pid       system calls made by process pid
+// sysstat cmd [arg ...] system calls made while cmd runs
+//
+// For each system call that was used, prints the number of
+// calls, the total, average and longest time in time-CSR
+// cycles, and the latency histogram's non-empty buckets as
+// <limit:calls.  The counts for cmd are those of the whole
+// system while it ran, except that max is the longest call
+// since boot.
+//
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/syscall.h"
+#include "kernel/sysstat.h"
+#include "user/user.h"
+
+static char *names[NSYSCALL] = {
+[SYS_fork]    "fork",
+[SYS_exit]    "exit",
+[SYS_wait]    "wait",
+[SYS_pipe]    "pipe",
+[SYS_read]    "read",
+[SYS_kill]    "kill",
+[SYS_exec]    "exec",
+[SYS_fstat]   "fstat",
+[SYS_chdir]   "chdir",
+[SYS_dup]     "dup",
+[SYS_getpid]  "getpid",
+[SYS_sbrk]    "sbrk",
+[SYS_sleep]   "sleep",
+[SYS_uptime]  "uptime",
+[SYS_open]    "open",
+[SYS_write]   "write",
+[SYS_mknod]   "mknod",
+[SYS_unlink]  "unlink",
+[SYS_link]    "link",
+[SYS_mkdir]   "mkdir",
+[SYS_close]   "close",
+[SYS_ntas]    "ntas",
+[SYS_crash]   "crash",
+[SYS_shmat]   "shmat",
+[SYS_shmdt]   "shmdt",
+[SYS_futex_wait] "futex_wait",
+[SYS_futex_wake] "futex_wake",
+[SYS_clone]   "clone",
+[SYS_join]    "join",
+[SYS_pread]   "pread",
+[SYS_pwrite]  "pwrite",
+[SYS_fsync]   "fsync",
+[SYS_ftruncate] "ftruncate",
+[SYS_sendfile] "sendfile",
+[SYS_splice]  "splice",
+[SYS_readv]   "readv",
+[SYS_writev]  "writev",
+[SYS_sysbatch] "sysbatch",
+[SYS_sysstat] "sysstat",
+[SYS_dmesg]   "dmesg",
+};
+
+struct sysstat before[NSYSCALL], after[NSYSCALL];
+
+void
+get(int pid, struct sysstat *st)
+{
+  if(sysstat(pid, st, NSYSCALL) < 0){
+    fprintf(2, "sysstat: no process %d\n", pid);
+    exit(1);
+  }
+}
+
+void
+print(struct sysstat *st)
+{
+  int num, i;
+
+  printf("call\tcount\tcycles\tavg\tmax\n");
+  for(num = 0; num < NSYSCALL; num++){
+    if(st[num].count == 0)
+      continue;
+    printf("%s\t%l\t%l\t%l\t%l\n", names[num] ? names[num] : "?",
+           st[num].count, st[num].cycles,
+           st[num].cycles / st[num].count, st[num].max);
+    printf("\t");
+    for(i = 0; i < NSYSHIST; i++){
+      if(st[num].hist[i] == 0)
+        continue;
+      if(i < NSYSHIST-1)
+        printf(" <%l:%l", 16UL << i, st[num].hist[i]);
+      else
+        printf(" >=%l:%l", 16UL << (i-1), st[num].hist[i]);
+    }
+    printf("\n");
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int pid, num, i;
+
+  if(argc == 1){
+    get(0, after);
+    print(after);
+    exit(0);
+  }
+  if(strcmp(argv[1], "-p") == 0){
+    if(argc != 3){
+      fprintf(2, "usage: sysstat [-p pid | cmd [arg ...]]\n");
+      exit(1);
+    }
+    get(atoi(argv[2]), after);
+    print(after);
+    exit(0);
+  }
+
+  get(0, before);
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "sysstat: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[1], argv + 1);
+    fprintf(2, "sysstat: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  wait(0);
+  get(0, after);
+
+  for(num = 0; num < NSYSCALL; num++){
+    after[num].count -= before[num].count;
+    after[num].cycles -= before[num].cycles;
+    for(i = 0; i < NSYSHIST; i++)
+      after[num].hist[i] -= before[num].hist[i];
+  }
+  print(after);
+  exit(0);
+}
@@ -0,0 +1,201 @@
+//
+// tests for kernel threads (clone/join).
+//
+
+#include "kernel/types.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+#define NTHREAD 4
+#define NITER 100000
+#define STACKSZ (2*PGSIZE)
+
+volatile int counter;
+volatile int go;
+char *volatile grown;
+
+// start a thread running fn(arg) on a fresh stack.
+int
+thread_create(void (*fn)(void*), void *arg)
+{
+  char *stack = sbrk(STACKSZ);
+
+  if(stack == (char*)-1)
+    return -1;
+  return clone(fn, arg, stack + STACKSZ);
+}
+
+void
+adder(void *arg)
+{
+  while(go == 0)
+    ;
+  for(int i = 0; i < NITER; i++)
+    __sync_fetch_and_add(&counter, 1);
+  exit((int)(uint64)arg);
+}
+
+// threads see each other's writes to global memory,
+// run at the same time, and are reaped by join.
+void
+sharetest()
+{
+  int i, tid, xstatus, sum;
+
+  printf("share: ");
+
+  counter = 0;
+  go = 0;
+  for(i = 0; i < NTHREAD; i++){
+    if(thread_create(adder, (void*)(uint64)(i + 1)) < 0){
+      printf("clone failed\n");
+      exit(-1);
+    }
+  }
+  go = 1;
+
+  sum = 0;
+  for(i = 0; i < NTHREAD; i++){
+    if((tid = join(&xstatus)) < 0){
+      printf("join failed\n");
+      exit(-1);
+    }
+    sum += xstatus;
+  }
+  if(join(0) != -1){
+    printf("join with no threads left did not fail\n");
+    exit(-1);
+  }
+  if(sum != NTHREAD*(NTHREAD+1)/2){
+    printf("wrong exit statuses\n");
+    exit(-1);
+  }
+  if(counter != NTHREAD*NITER){
+    printf("counter %d, expected %d\n", counter, NTHREAD*NITER);
+    exit(-1);
+  }
+
+  printf("ok\n");
+}
+
+void
+grower(void *arg)
+{
+  char *p = sbrk(10*PGSIZE);
+
+  if(p == (char*)-1)
+    exit(-1);
+  p[10*PGSIZE - 1] = 'x';
+  grown = p;
+  exit(0);
+}
+
+void
+waiter(void *arg)
+{
+  while(go == 0)
+    ;
+  exit(0);
+}
+
+// memory one thread adds with sbrk is usable by the others,
+// both directly and by system calls.  memory can't be given
+// back while another thread might be using it.
+void
+sbrktest()
+{
+  int xstatus, fds[2];
+  char c;
+
+  printf("sbrk: ");
+
+  grown = 0;
+  if(thread_create(grower, 0) < 0){
+    printf("clone failed\n");
+    exit(-1);
+  }
+  if(join(&xstatus) < 0 || xstatus != 0 || grown == 0){
+    printf("grower failed\n");
+    exit(-1);
+  }
+  if(grown[10*PGSIZE - 1] != 'x'){
+    printf("grown memory not shared\n");
+    exit(-1);
+  }
+  if(pipe(fds) < 0 || write(fds[1], grown + 10*PGSIZE - 1, 1) != 1 ||
+     read(fds[0], &c, 1) != 1 || c != 'x'){
+    printf("kernel can't see grown memory\n");
+    exit(-1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+
+  go = 0;
+  if(thread_create(waiter, 0) < 0){
+    printf("clone failed\n");
+    exit(-1);
+  }
+  if(sbrk(-PGSIZE) != (char*)-1){
+    printf("shrank memory another thread shares\n");
+    exit(-1);
+  }
+  go = 1;
+  if(join(&xstatus) < 0 || xstatus != 0){
+    printf("waiter failed\n");
+    exit(-1);
+  }
+  if(sbrk(-PGSIZE) == (char*)-1){
+    printf("can't shrink memory after join\n");
+    exit(-1);
+  }
+
+  printf("ok\n");
+}
+
+void
+spinner(void *arg)
+{
+  for(;;)
+    counter++;
+}
+
+// a process that exits takes its threads with it, and
+// they don't show up in wait().
+void
+exittest()
+{
+  int pid, xstatus;
+
+  printf("exit: ");
+
+  pid = fork();
+  if(pid < 0){
+    printf("fork failed\n");
+    exit(-1);
+  }
+  if(pid == 0){
+    for(int i = 0; i < NTHREAD; i++)
+      if(thread_create(spinner, 0) < 0)
+        exit(-1);
+    if(wait(0) != -1)
+      exit(-1);
+    sleep(2);
+    exit(0);
+  }
+  if(wait(&xstatus) != pid || xstatus != 0){
+    printf("child failed\n");
+    exit(-1);
+  }
+
+  printf("ok\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  sharetest();
+  sbrktest();
+  exittest();
+  printf("ALL THREAD TESTS PASSED\n");
+  exit(0);
+}
@@ -0,0 +1,208 @@
+//
+// trace command [arg ...]
+//
+// Run command with kernel tracing on, then print the events it
+// caused, merged from all CPUs into one timeline.  Each line is
+//   time cpu pid event ...
+// with time in time-CSR cycles since the first event.  Events
+// that end something started earlier (a disk request, a commit
+// phase, a process's turn on a CPU) also show, after a +, how
+// long that took.
+//
+
+#include "kernel/types.h"
+#include "kernel/spinlock.h"
+#include "kernel/sleeplock.h"
+#include "kernel/fs.h"
+#include "kernel/file.h"
+#include "kernel/trace.h"
+#include "user/user.h"
+#include "user/evdev.h"
+
+#define NPEND 64   // disk requests matched up at once
+
+struct traceevent buf[32], *ev;
+int nev, maxev;
+
+// start times, for the events that end something.
+struct { int disk, blockno; uint64 time; } pend[NPEND];
+uint64 commitstart[2], runstart[256];
+
+char *states[] = { "unused", "sleeping", "runnable", "running", "zombie" };
+
+void
+add(void *rec)
+{
+  struct traceevent *e = rec, *bigger;
+
+  if(nev == maxev){
+    maxev = maxev ? 2*maxev : 256;
+    if((bigger = malloc(maxev * sizeof(*ev))) == 0){
+      fprintf(2, "trace: out of memory\n");
+      exit(1);
+    }
+    memmove(bigger, ev, nev * sizeof(*ev));
+    free(ev);
+    ev = bigger;
+  }
+  ev[nev++] = *e;
+}
+
+// sort ev[lo..hi) by time.  each CPU's events arrive in order,
+// so this merges runs more than it sorts.
+void
+sort(struct traceevent *tmp, int lo, int hi)
+{
+  int mid, i, j, k;
+
+  if(hi - lo < 2)
+    return;
+  mid = (lo + hi) / 2;
+  sort(tmp, lo, mid);
+  sort(tmp, mid, hi);
+  if(ev[mid-1].time <= ev[mid].time)
+    return;
+  for(i = lo, j = mid, k = lo; k < hi; k++){
+    if(j == hi || (i < mid && ev[i].time <= ev[j].time))
+      tmp[k] = ev[i++];
+    else
+      tmp[k] = ev[j++];
+  }
+  memmove(ev + lo, tmp + lo, (hi - lo) * sizeof(*ev));
+}
+
+// how long since *start, if it was set?  clears it.
+uint64
+since(uint64 *start, uint64 now)
+{
+  uint64 t = *start;
+
+  *start = 0;
+  return t ? now - t : 0;
+}
+
+// how long since the matching disk request started?
+uint64
+diskdone(struct traceevent *e)
+{
+  int i;
+
+  for(i = 0; i < NPEND; i++){
+    if(pend[i].time && pend[i].disk == e->arg[0] && pend[i].blockno == e->arg[1])
+      return since(&pend[i].time, e->time);
+  }
+  return 0;
+}
+
+void
+print(struct traceevent *e, uint64 t0)
+{
+  uint64 took = 0;
+  int i;
+
+  printf("%l %d %d ", e->time - t0, e->cpu, e->pid);
+  switch(e->type){
+  case TR_TRAP:
+    if(e->arg[0] == 8)
+      printf("syscall %d", (int)e->arg[2]);
+    else
+      printf("trap scause %p sepc %p", e->arg[0], e->arg[1]);
+    break;
+  case TR_RUN:
+    printf("run %d", (int)e->arg[0]);
+    runstart[e->arg[0] % 256] = e->time;
+    break;
+  case TR_STOP:
+    printf("stop %d %s", (int)e->arg[0], e->arg[1] < 5 ? states[e->arg[1]] : "?");
+    took = since(&runstart[e->arg[0] % 256], e->time);
+    break;
+  case TR_SLEEP:
+    printf("sleep %p", e->arg[0]);
+    break;
+  case TR_WAKEUP:
+    printf("wakeup %d %p", (int)e->arg[0], e->arg[1]);
+    break;
+  case TR_BHIT:
+    printf("bcache hit %d %d", (int)e->arg[0], (int)e->arg[1]);
+    break;
+  case TR_BMISS:
+    printf("bcache miss %d %d", (int)e->arg[0], (int)e->arg[1]);
+    break;
+  case TR_BEVICT:
+    printf("bcache evict %d %d", (int)e->arg[0], (int)e->arg[1]);
+    break;
+  case TR_BEGINOP:
+    printf("begin_op %d %d", (int)e->arg[0], (int)e->arg[1]);
+    break;
+  case TR_ENDOP:
+    printf("end_op %d %d", (int)e->arg[0], (int)e->arg[1]);
+    break;
+  case TR_COMMIT:
+    printf("commit %d %d blocks", (int)e->arg[0], (int)e->arg[1]);
+    commitstart[e->arg[0] % 2] = e->time;
+    break;
+  case TR_COMMITLOGGED:
+    printf("commit logged %d seq %d", (int)e->arg[0], (int)e->arg[1]);
+    if(commitstart[e->arg[0] % 2])
+      took = e->time - commitstart[e->arg[0] % 2];
+    break;
+  case TR_COMMITDONE:
+    printf("commit done %d seq %d", (int)e->arg[0], (int)e->arg[1]);
+    took = since(&commitstart[e->arg[0] % 2], e->time);
+    break;
+  case TR_DISKSTART:
+    printf("disk %s %d %d", e->arg[2] ? "write" : "read", (int)e->arg[0], (int)e->arg[1]);
+    for(i = 0; i < NPEND; i++){
+      if(pend[i].time == 0){
+        pend[i].disk = e->arg[0];
+        pend[i].blockno = e->arg[1];
+        pend[i].time = e->time;
+        break;
+      }
+    }
+    break;
+  case TR_DISKDONE:
+    printf("disk done %d %d", (int)e->arg[0], (int)e->arg[1]);
+    took = diskdone(e);
+    break;
+  case TR_LOST:
+    printf("lost %d events", (int)e->arg[0]);
+    break;
+  default:
+    printf("event %d", e->type);
+  }
+  if(took)
+    printf(" +%l", took);
+  printf("\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct traceevent *tmp;
+  int fd, i;
+
+  if(argc < 2){
+    fprintf(2, "usage: trace command [arg ...]\n");
+    exit(1);
+  }
+  if((fd = evstart("/trace", TRACE)) < 0){
+    fprintf(2, "trace: cannot start tracing\n");
+    exit(1);
+  }
+  if(evrun(fd, argv + 1, "trace") < 0)
+    exit(1);
+  evdrain(fd, buf, sizeof(buf), sizeof(buf[0]), add);
+  wait(0);
+  if(nev == 0)
+    exit(0);
+
+  if((tmp = malloc(nev * sizeof(*ev))) == 0){
+    fprintf(2, "trace: out of memory\n");
+    exit(1);
+  }
+  sort(tmp, 0, nev);
+  for(i = 0; i < nev; i++)
+    print(&ev[i], ev[0].time);
+  exit(0);
+}
@@ -52,24 +52,6 @@ strchr(const char *s, char c)
   return 0;
 }
 
-char*
-gets(char *buf, int max)
-{
-  int i, cc;
-  char c;
-
-  for(i=0; i+1 < max; ){
-    cc = read(0, &c, 1);
-    if(cc < 1)
-      break;
-    buf[i++] = c;
-    if(c == '\n' || c == '\r')
-      break;
-  }
-  buf[i] = '\0';
-  return buf;
-}
-
 int
 stat(const char *n, struct stat *st)
 {
@@ -107,3 +89,15 @@ memmove(void *vdst, const void *vsrc, int n)
     *dst++ = *src++;
   return vdst;
 }
+
+// stdio.c's, in programs linked with it; forktest isn't.
+#pragma weak fflush
+
+// Write out what stdio has buffered, then exit.
+int
+exit(int status)
+{
+  if(fflush)
+    fflush(0);
+  _exit(status);
+}
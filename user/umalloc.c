@@ -3,26 +3,49 @@
 #include "user/user.h"
 #include "kernel/param.h"
 
-// Memory allocator by Kernighan and Ritchie,
-// The C programming Language, 2nd ed.  Section 8.7.
+// Memory allocator.
+//
+// Requests for up to MAXSMALL bytes are rounded up to one of
+// NCLASS size classes, 16 bytes to 2 KB in powers of two, and
+// served from a free list per class: malloc() pops a block off
+// the list and free() pushes it back on, with no searching.
+// An empty list is refilled by cutting a CHUNK from the large
+// allocator into blocks of its class.
+//
+// Larger requests go to the allocator by Kernighan and Ritchie,
+// The C programming Language, 2nd ed.  Section 8.7, which gets
+// memory from sbrk() a page at a time as it needs it, and gives
+// it back with a negative sbrk() once TRIM bytes are free at
+// the top of the heap, keeping KEEP bytes so that a program
+// that frees and allocates again doesn't call sbrk() each time.
 
 typedef long Align;
 
 union header {
   struct {
     union header *ptr;
-    uint size;
+    uint size;      // in units; or SMALL|class for a small block
   } s;
   Align x;
 };
 
 typedef union header Header;
 
+#define PAGE     4096
+#define NCLASS   8
+#define MINSMALL 16
+#define MAXSMALL (MINSMALL << (NCLASS-1))
+#define SMALL    0x80000000
+#define CHUNK    (4*PAGE - sizeof(Header))
+#define TRIM     (16*PAGE)
+#define KEEP     (4*PAGE)
+
 static Header base;
 static Header *freep;
+static Header *freelist[NCLASS];
 
-void
-free(void *ap)
+static void
+bigfree(void *ap)
 {
   Header *bp, *p;
 
@@ -48,20 +71,48 @@ morecore(uint nu)
 {
   char *p;
   Header *hp;
+  uint n;
 
-  if(nu < 4096)
-    nu = 4096;
-  p = sbrk(nu * sizeof(Header));
+  n = (nu * sizeof(Header) + PAGE - 1) / PAGE * PAGE;
+  p = sbrk(n);
   if(p == (char*)-1)
     return 0;
   hp = (Header*)p;
-  hp->s.size = nu;
-  free((void*)(hp + 1));
+  hp->s.size = n / sizeof(Header);
+  bigfree((void*)(hp + 1));
   return freep;
 }
 
-void*
-malloc(uint nbytes)
+// Give most of the free block at the top of the heap, if
+// any, back to the kernel, once it is big enough to be
+// worth it.
+static void
+trim(void)
+{
+  Header *p, *prevp;
+  char *top;
+  int n;
+
+  top = sbrk(0);
+  prevp = freep;
+  do {
+    p = prevp->s.ptr;
+    if((char*)(p + p->s.size) == top)
+      break;
+    prevp = p;
+  } while(prevp != freep);
+  if((char*)(p + p->s.size) != top || p == &base ||
+     top - (char*)p < TRIM)
+    return;
+
+  // the kernel refuses while threads share the memory.
+  n = (top - (char*)p - KEEP) / PAGE * PAGE;
+  if(sbrk(-n) != (char*)-1)
+    p->s.size -= n / sizeof(Header);
+}
+
+static void*
+bigalloc(uint nbytes)
 {
   Header *p, *prevp;
   uint nunits;
@@ -88,3 +139,58 @@ malloc(uint nbytes)
         return 0;
   }
 }
+
+// Fill the empty free list of class c from a new chunk.
+// Returns 0, or -1 if out of memory.
+static int
+refill(int c)
+{
+  uint bsize = sizeof(Header) + (MINSMALL << c);
+  char *p;
+  Header *h;
+  int i;
+
+  if((p = bigalloc(CHUNK)) == 0)
+    return -1;
+  for(i = CHUNK / bsize - 1; i >= 0; i--){
+    h = (Header*)(p + i*bsize);
+    h->s.size = SMALL | c;
+    h->s.ptr = freelist[c];
+    freelist[c] = h;
+  }
+  return 0;
+}
+
+void
+free(void *ap)
+{
+  Header *h;
+
+  if(ap == 0)
+    return;
+  h = (Header*)ap - 1;
+  if(h->s.size & SMALL){
+    h->s.ptr = freelist[h->s.size & ~SMALL];
+    freelist[h->s.size & ~SMALL] = h;
+    return;
+  }
+  bigfree(ap);
+  trim();
+}
+
+void*
+malloc(uint nbytes)
+{
+  Header *h;
+  int c;
+
+  if(nbytes > MAXSMALL)
+    return bigalloc(nbytes);
+  for(c = 0; (MINSMALL << c) < nbytes; c++)
+    ;
+  if(freelist[c] == 0 && refill(c) < 0)
+    return 0;
+  h = freelist[c];
+  freelist[c] = h->s.ptr;
+  return (void*)(h + 1);
+}
@@ -1,9 +1,12 @@
 struct stat;
 struct rtcdate;
+struct iovec;
+struct sysreq;
+struct sysstat;
 
 // system calls
 int fork(void);
-int exit(int) __attribute__((noreturn));
+int _exit(int) __attribute__((noreturn));
 int wait(int*);
 int pipe(int*);
 int write(int, const void*, int);
@@ -27,18 +30,81 @@ int ntas();
 int crash(const char*, int);
 int mount(char*, char *);
 int umount(char*);
+void* shmat(int, int);
+int shmdt(void*);
+int futex_wait(int*, int);
+int futex_wake(int*, int);
+int clone(void(*)(void*), void*, void*);
+int join(int*);
+int pread(int, void*, int, int);
+int pwrite(int, const void*, int, int);
+int fsync(int);
+int ftruncate(int, int);
+int sendfile(int, int, int, int);
+int splice(int, int, int);
+int readv(int, struct iovec*, int);
+int writev(int, const struct iovec*, int);
+int sysbatch(struct sysreq*, int);
+int sysstat(int, struct sysstat*, int);
+int dmesg(char*, int);
 
 // ulib.c
+int exit(int) __attribute__((noreturn));
 int stat(const char*, struct stat*);
 char* strcpy(char*, const char*);
 void *memmove(void*, const void*, int);
 char* strchr(const char*, char c);
 int strcmp(const char*, const char*);
-void fprintf(int, const char*, ...);
-void printf(const char*, ...);
 char* gets(char*, int max);
 uint strlen(const char*);
 void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
 int atoi(const char*);
+
+// stdio.c
+#define BUFSIZ 512
+#define IOREAD  0x1   // open for reading
+#define IOWRITE 0x2   // open for writing
+#define IOLINE  0x4   // flush at each newline
+#define IOEOF   0x8
+#define IOERR   0x10
+#define IONBF   0x20  // unbuffered
+#define IOMYBUF 0x40  // buf is from setvbuf()'s malloc()
+
+// modes for setvbuf()
+#define _IOFBF 0      // fully buffered
+#define _IOLBF 1      // line buffered
+#define _IONBF 2      // unbuffered
+
+// a buffered stream.  when reading, buf[pos..len) is data
+// read ahead; when writing, buf[0..pos) is waiting to go out
+// and len is 0.
+typedef struct iobuf {
+  int fd;
+  int flags;
+  char *buf;
+  int size;
+  int pos;
+  int len;
+  struct iobuf *next;  // the next open stream
+} FILE;
+
+extern FILE *stdin, *stdout, *stderr;
+FILE* fopen(const char*, const char*);
+FILE* fdopen(int, const char*);
+int fclose(FILE*);
+int fflush(FILE*);
+int setvbuf(FILE*, char*, int, int);
+int fread(void*, int, int, FILE*);
+int fwrite(const void*, int, int, FILE*);
+int fgetc(FILE*);
+int fputc(int, FILE*);
+int fputs(const char*, FILE*);
+char* fgets(char*, int, FILE*);
+int feof(FILE*);
+int ferror(FILE*);
+
+// printf.c
+void fprintf(int, const char*, ...);
+void printf(const char*, ...);
@@ -3,10 +3,18 @@
 #include "kernel/stat.h"
 #include "user/user.h"
 #include "kernel/fs.h"
+#include "kernel/spinlock.h"
+#include "kernel/sleeplock.h"
+#include "kernel/file.h"
 #include "kernel/fcntl.h"
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
+#include "kernel/uio.h"
+#include "kernel/prof.h"
+#include "kernel/sysstat.h"
+#include "kernel/trace.h"
+#include "user/evdev.h"
 
 #define BUFSZ  (MAXOPBLOCKS+2)*BSIZE
 
@@ -358,6 +366,73 @@ pipe1(void)
   printf("pipe1 ok\n");
 }
 
+// stream many pages through a pipe, reading both whole
+// page-aligned pages (which the kernel may hand over without
+// copying) and odd-sized, unaligned pieces.
+void
+pipe2(void)
+{
+  int fds[2], pid;
+  int i, n, total, xstatus;
+  uint seq;
+  char *p, *q;
+  enum { NPAGES=64 };
+
+  if(pipe(fds) != 0){
+    printf("pipe() failed\n");
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("fork() failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    p = sbrk(4*PGSIZE);
+    seq = 0;
+    for(n = 0; n < NPAGES; n += 4){
+      for(i = 0; i < 4*PGSIZE; i++)
+        p[i] = (seq++ * 7) & 0xff;
+      if(write(fds[1], p, 4*PGSIZE) != 4*PGSIZE){
+        printf("pipe2 write failed\n");
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+  close(fds[1]);
+  p = sbrk(2*PGSIZE);
+  q = (char*)PGROUNDUP((uint64)p);
+  seq = 0;
+  total = 0;
+  for(i = 0; ; i++){
+    // alternate page-aligned whole-page reads with 1000-byte ones.
+    if(i % 2 == 0)
+      n = read(fds[0], q, PGSIZE);
+    else
+      n = read(fds[0], q + 3, 1000);
+    if(n <= 0)
+      break;
+    for(int k = 0; k < n; k++){
+      if((q[(i % 2 ? 3 : 0) + k] & 0xff) != ((seq++ * 7) & 0xff)){
+        printf("pipe2 wrong data at %d\n", total + k);
+        exit(1);
+      }
+    }
+    total += n;
+  }
+  if(total != NPAGES*PGSIZE){
+    printf("pipe2 total %d\n", total);
+    exit(1);
+  }
+  close(fds[0]);
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+  printf("pipe2 ok\n");
+}
+
 // meant to be run w/ at most two CPUs
 void
 preempt(void)
@@ -819,6 +894,650 @@ createdelete(void)
   printf("createdelete ok\n");
 }
 
+// names that the kernel has looked up (and remembered as
+// present or absent) must track creates, unlinks, and
+// directories being removed and their inodes reused.
+void
+namecache(void)
+{
+  int fd, i;
+
+  printf("namecache test\n");
+  for(i = 0; i < 3; i++){
+    if(open("nc", O_RDONLY) >= 0 || open("ncd/x", O_RDONLY) >= 0){
+      printf("namecache: open of missing file succeeded\n");
+      exit(1);
+    }
+    if(mkdir("ncd") != 0 || (fd = open("ncd/x", O_CREATE|O_RDWR)) < 0){
+      printf("namecache: create failed\n");
+      exit(1);
+    }
+    close(fd);
+    if(link("ncd/x", "nc") != 0 || (fd = open("nc", O_RDONLY)) < 0){
+      printf("namecache: open of new link failed\n");
+      exit(1);
+    }
+    close(fd);
+    if(open("ncd/../nc", O_RDONLY) < 0){
+      printf("namecache: .. lookup failed\n");
+      exit(1);
+    }
+    if(unlink("ncd/x") != 0 || open("ncd/x", O_RDONLY) >= 0){
+      printf("namecache: unlinked file still found\n");
+      exit(1);
+    }
+    if(unlink("ncd") != 0 || unlink("nc") != 0){
+      printf("namecache: unlink failed\n");
+      exit(1);
+    }
+  }
+  printf("namecache ok\n");
+}
+
+// pread/pwrite use their own offsets, not the file's;
+// ftruncate shrinks a file and grows it with zeros;
+// fsync succeeds on files and fails on pipes.
+void
+posio(void)
+{
+  int fd, i, fds[2];
+  char c;
+
+  printf("posio test\n");
+  unlink("posio");
+  fd = open("posio", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("posio: create failed\n");
+    exit(1);
+  }
+  for(i = 0; i < 3*BSIZE; i++)
+    buf[i] = 'a' + i % 26;
+  if(pwrite(fd, buf, 3*BSIZE, 0) != 3*BSIZE){
+    printf("posio: pwrite failed\n");
+    exit(1);
+  }
+  if(pwrite(fd, "x", 1, 4*BSIZE) != -1){
+    printf("posio: pwrite past end succeeded\n");
+    exit(1);
+  }
+  // the file's own offset hasn't moved.
+  if(read(fd, &c, 1) != 1 || c != 'a'){
+    printf("posio: pwrite moved the offset\n");
+    exit(1);
+  }
+  if(pwrite(fd, "Z", 1, BSIZE+1) != 1 || pread(fd, &c, 1, BSIZE+1) != 1 || c != 'Z'){
+    printf("posio: pread of pwrite failed\n");
+    exit(1);
+  }
+  if(read(fd, &c, 1) != 1 || c != 'b'){
+    printf("posio: pread moved the offset\n");
+    exit(1);
+  }
+  if(fsync(fd) != 0){
+    printf("posio: fsync failed\n");
+    exit(1);
+  }
+
+  if(ftruncate(fd, BSIZE+10) != 0 || pread(fd, buf, 3*BSIZE, 0) != BSIZE+10){
+    printf("posio: shrinking ftruncate failed\n");
+    exit(1);
+  }
+  if(ftruncate(fd, 2*BSIZE) != 0 || pread(fd, buf, 3*BSIZE, 0) != 2*BSIZE){
+    printf("posio: growing ftruncate failed\n");
+    exit(1);
+  }
+  if(buf[BSIZE+1] != 'Z' || buf[BSIZE+9] != 'a' + (BSIZE+9) % 26){
+    printf("posio: ftruncate lost data\n");
+    exit(1);
+  }
+  for(i = BSIZE+10; i < 2*BSIZE; i++){
+    if(buf[i] != 0){
+      printf("posio: ftruncate didn't zero byte %d\n", i);
+      exit(1);
+    }
+  }
+  close(fd);
+  unlink("posio");
+
+  if(pipe(fds) != 0){
+    printf("posio: pipe failed\n");
+    exit(1);
+  }
+  if(fsync(fds[0]) != -1 || pread(fds[0], &c, 1, 0) != -1 ||
+     ftruncate(fds[1], 0) != -1){
+    printf("posio: pipe accepted fsync, pread or ftruncate\n");
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  printf("posio ok\n");
+}
+
+// sendfile copies a file into a pipe and into another file;
+// splice moves pipe data into a file.
+void
+sendsplice(void)
+{
+  enum { SZ = 3*BSIZE + 100 };
+  int fd, fd2, fds[2], i, n;
+  char c;
+
+  printf("sendsplice test\n");
+  fd = open("sendsrc", O_CREATE|O_RDWR);
+  fd2 = open("senddst", O_CREATE|O_RDWR);
+  if(fd < 0 || fd2 < 0){
+    printf("sendsplice: create failed\n");
+    exit(1);
+  }
+  for(i = 0; i < SZ; i++)
+    buf[i] = i % 251;
+  if(write(fd, buf, SZ) != SZ){
+    printf("sendsplice: write failed\n");
+    exit(1);
+  }
+
+  // explicit offsets leave fd's own offset (at EOF) alone.
+  if(pipe(fds) != 0){
+    printf("sendsplice: pipe failed\n");
+    exit(1);
+  }
+  if(sendfile(fds[1], fd, 10, SZ) != SZ - 10 || sendfile(fds[1], fd, -1, 1) != 0){
+    printf("sendsplice: sendfile to pipe failed\n");
+    exit(1);
+  }
+  close(fds[1]);
+  for(n = 0; (i = read(fds[0], buf + SZ, SZ)) > 0; n += i){
+    for(int k = 0; k < i; k++){
+      if(buf[SZ + k] != buf[10 + n + k]){
+        printf("sendsplice: wrong data from pipe\n");
+        exit(1);
+      }
+    }
+  }
+  close(fds[0]);
+  if(n != SZ - 10){
+    printf("sendsplice: read %d from pipe\n", n);
+    exit(1);
+  }
+
+  // file to file, through the files' offsets.
+  close(fd);
+  if((fd = open("sendsrc", O_RDONLY)) < 0 || sendfile(fd2, fd, -1, SZ) != SZ){
+    printf("sendsplice: sendfile to file failed\n");
+    exit(1);
+  }
+  // and a pipe into the end of the file.
+  if(pipe(fds) != 0 || write(fds[1], "xyz", 3) != 3){
+    printf("sendsplice: pipe failed\n");
+    exit(1);
+  }
+  if(splice(fds[0], fd2, 100) != 3 || splice(fd, fd2, 1) != -1){
+    printf("sendsplice: splice failed\n");
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  close(fd2);
+
+  fd2 = open("senddst", O_RDONLY);
+  if(read(fd2, buf + SZ, SZ + 10) != SZ + 3){
+    printf("sendsplice: wrong size\n");
+    exit(1);
+  }
+  for(i = 0; i < SZ; i++){
+    if(buf[SZ + i] != buf[i]){
+      printf("sendsplice: wrong data at %d\n", i);
+      exit(1);
+    }
+  }
+  c = buf[2*SZ + 2];
+  if(c != 'z'){
+    printf("sendsplice: spliced data missing\n");
+    exit(1);
+  }
+  close(fd);
+  close(fd2);
+  unlink("sendsrc");
+  unlink("senddst");
+  printf("sendsplice ok\n");
+}
+
+// writev and readv gather and scatter through several
+// buffers; sysbatch runs several system calls at once.
+void
+iovbatch(void)
+{
+  struct iovec v[3];
+  struct sysreq r[4];
+  char a[4], b[8];
+  int fd;
+
+  printf("iovbatch test\n");
+  fd = open("iov", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("iovbatch: create failed\n");
+    exit(1);
+  }
+  v[0].base = "ab";
+  v[0].len = 2;
+  v[1].base = "";
+  v[1].len = 0;
+  v[2].base = "cdefgh";
+  v[2].len = 6;
+  if(writev(fd, v, 3) != 8){
+    printf("iovbatch: writev failed\n");
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("iov", O_RDONLY);
+  v[0].base = a;
+  v[0].len = sizeof(a);
+  v[1].base = b;
+  v[1].len = sizeof(b);
+  if(readv(fd, v, 2) != 8 || a[0] != 'a' || a[3] != 'd' || b[0] != 'e' || b[3] != 'h'){
+    printf("iovbatch: readv failed\n");
+    exit(1);
+  }
+  if(readv(fd, v, MAXIOV+1) != -1){
+    printf("iovbatch: readv of too many buffers succeeded\n");
+    exit(1);
+  }
+  close(fd);
+
+  r[0].num = SYS_getpid;
+  r[1].num = SYS_unlink;
+  r[1].arg[0] = (uint64)"iov";
+  r[2].num = SYS_fork;
+  r[3].num = SYS_open;
+  r[3].arg[0] = (uint64)"iov";
+  r[3].arg[1] = O_RDONLY;
+  if(sysbatch(r, 4) != 4){
+    printf("iovbatch: sysbatch failed\n");
+    exit(1);
+  }
+  if(r[0].ret != getpid() || r[1].ret != 0 || r[2].ret != -1 || r[3].ret != -1){
+    printf("iovbatch: wrong sysbatch results\n");
+    exit(1);
+  }
+  printf("iovbatch ok\n");
+}
+
+// streams buffer small writes and reads; "w" empties a file.
+void
+stdiotest(void)
+{
+  FILE *f;
+  char line[32];
+  int i, c, fd, pid;
+
+  printf("stdio test\n");
+  for(int round = 0; round < 2; round++){
+    if((f = fopen("stdio", "w")) == 0){
+      printf("stdio: fopen for writing failed\n");
+      exit(1);
+    }
+    for(i = 0; i < 1000; i++)
+      fputc('0' + i % 10, f);
+    if(fputs("\nlast line\n", f) != 0 || fclose(f) != 0){
+      printf("stdio: write failed\n");
+      exit(1);
+    }
+  }
+
+  if((f = fopen("stdio", "r")) == 0){
+    printf("stdio: fopen for reading failed\n");
+    exit(1);
+  }
+  for(i = 0; i < 1000; i++){
+    if((c = fgetc(f)) != '0' + i % 10){
+      printf("stdio: got %d at %d\n", c, i);
+      exit(1);
+    }
+  }
+  if(fgets(line, sizeof(line), f) == 0 || strcmp(line, "\n") != 0 ||
+     fgets(line, sizeof(line), f) == 0 || strcmp(line, "last line\n") != 0){
+    printf("stdio: fgets failed\n");
+    exit(1);
+  }
+  if(fgetc(f) != -1 || !feof(f)){
+    printf("stdio: no end of file\n");
+    exit(1);
+  }
+  fclose(f);
+
+  // an unbuffered stream leaves the rest for read(); a
+  // buffered one can't write where it has read ahead.
+  if((f = fopen("stdio", "r+")) == 0 || setvbuf(f, 0, _IONBF, 0) != 0){
+    printf("stdio: setvbuf failed\n");
+    exit(1);
+  }
+  if(fgetc(f) != '0' || read(f->fd, line, 1) != 1 || line[0] != '1'){
+    printf("stdio: unbuffered stream read ahead\n");
+    exit(1);
+  }
+  fclose(f);
+  if((f = fopen("stdio", "r+")) == 0){
+    printf("stdio: fopen for update failed\n");
+    exit(1);
+  }
+  if(fgetc(f) != '0' || fputc('x', f) != -1 || !ferror(f)){
+    printf("stdio: wrote over read-ahead\n");
+    exit(1);
+  }
+  fclose(f);
+
+  // exit() writes out what a stream still has buffered.
+  pid = fork();
+  if(pid < 0){
+    printf("stdio: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    if((f = fopen("stdio", "w")) == 0)
+      exit(1);
+    fputs("bye", f);
+    exit(0);
+  }
+  wait(0);
+  if((fd = open("stdio", O_RDONLY)) < 0 || read(fd, line, sizeof(line)) != 3){
+    printf("stdio: exit lost buffered output\n");
+    exit(1);
+  }
+  close(fd);
+  unlink("stdio");
+  printf("stdio ok\n");
+}
+
+int profpid, sawsample;
+
+void
+profcheck(void *rec)
+{
+  struct profsample *s = rec;
+
+  if(s->pid == profpid && s->depth > 0)
+    sawsample = 1;
+}
+
+// the profiler catches a process that keeps a CPU busy.
+void
+proftest(void)
+{
+  struct profsample s[8];
+  int fd, t0;
+
+  printf("prof test\n");
+  unlink("profdev");
+  if((fd = evstart("profdev", PROF)) < 0){
+    printf("prof: cannot start\n");
+    exit(1);
+  }
+  t0 = uptime();
+  while(uptime() - t0 < 5)
+    ;
+  write(fd, "0", 1);
+
+  profpid = getpid();
+  sawsample = 0;
+  evdrain(fd, s, sizeof(s), sizeof(s[0]), profcheck);
+  close(fd);
+  unlink("profdev");
+  if(!sawsample){
+    printf("prof: no samples of this process\n");
+    exit(1);
+  }
+  printf("prof ok\n");
+}
+
+struct traceevent tev[16];
+int tracepid, sawcall, sawop;
+
+void
+tracecheck(void *rec)
+{
+  struct traceevent *e = rec;
+
+  if(e->pid != tracepid)
+    return;
+  if(e->type == TR_TRAP && e->arg[0] == 8 && e->arg[2] == SYS_open)
+    sawcall = 1;
+  if(e->type == TR_BEGINOP)
+    sawop = 1;
+}
+
+// tracing records this process's system calls and the log
+// operations of a file write.
+void
+tracetest(void)
+{
+  int fd, tfd;
+
+  printf("trace test\n");
+  unlink("tracedev");
+  if((tfd = evstart("tracedev", TRACE)) < 0){
+    printf("trace: cannot start\n");
+    exit(1);
+  }
+  fd = open("tracefile", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, "x", 1) != 1){
+    printf("trace: cannot write tracefile\n");
+    exit(1);
+  }
+  close(fd);
+  write(tfd, "0", 1);
+
+  tracepid = getpid();
+  sawcall = sawop = 0;
+  evdrain(tfd, tev, sizeof(tev), sizeof(tev[0]), tracecheck);
+  close(tfd);
+  unlink("tracedev");
+  unlink("tracefile");
+  if(!sawcall || !sawop){
+    printf("trace: events missing\n");
+    exit(1);
+  }
+  printf("trace ok\n");
+}
+
+#define NSPREAD 4
+int spreadpid[NSPREAD];
+uint spreadcpus;
+
+void
+spreadcheck(void *rec)
+{
+  struct traceevent *e = rec;
+  int i;
+
+  if(e->type != TR_RUN)
+    return;
+  for(i = 0; i < NSPREAD; i++)
+    if(e->arg[0] == spreadpid[i])
+      spreadcpus |= 1 << e->cpu;
+}
+
+// children that keep a CPU busy get run by the idle CPUs,
+// which must be woken for them, not left to queue for this one.
+void
+spreadtest(void)
+{
+  volatile int spin;
+  int tfd, i, j, t0, ncpu;
+
+  printf("spread test\n");
+  unlink("tracedev");
+  if((tfd = evstart("tracedev", TRACE)) < 0){
+    printf("spread: cannot start tracing\n");
+    exit(1);
+  }
+  for(i = 0; i < NSPREAD; i++){
+    spreadpid[i] = fork();
+    if(spreadpid[i] < 0){
+      printf("spread: fork failed\n");
+      exit(1);
+    }
+    if(spreadpid[i] == 0){
+      t0 = uptime();
+      while(uptime() - t0 < 3)
+        for(j = 0; j < 1000000; j++)
+          spin++;
+      exit(0);
+    }
+  }
+  for(i = 0; i < NSPREAD; i++)
+    wait(0);
+  write(tfd, "0", 1);
+
+  spreadcpus = 0;
+  evdrain(tfd, tev, sizeof(tev), sizeof(tev[0]), spreadcheck);
+  close(tfd);
+  unlink("tracedev");
+  for(ncpu = 0; spreadcpus; spreadcpus &= spreadcpus - 1)
+    ncpu++;
+  if(ncpu < 2){
+    printf("spread: children all ran on one CPU\n");
+    exit(1);
+  }
+  printf("spread ok\n");
+}
+
+struct sysstat sstat[SYS_getpid+1];
+
+// sysstat() counts the calls of each process and of the system.
+void
+sysstattest(void)
+{
+  uint64 before, n;
+  int i, pid;
+
+  printf("sysstat test\n");
+  if(sysstat(0, sstat, SYS_getpid+1) != NSYSCALL){
+    printf("sysstat: system-wide counts failed\n");
+    exit(1);
+  }
+  before = sstat[SYS_getpid].count;
+  for(i = 0; i < 20; i++)
+    pid = getpid();
+
+  if(sysstat(pid, sstat, SYS_getpid+1) < 0){
+    printf("sysstat: counts for this process failed\n");
+    exit(1);
+  }
+  if(sstat[SYS_getpid].count < 20 ||
+     sstat[SYS_getpid].max > sstat[SYS_getpid].cycles){
+    printf("sysstat: bad counts for this process\n");
+    exit(1);
+  }
+  n = 0;
+  for(i = 0; i < NSYSHIST; i++)
+    n += sstat[SYS_getpid].hist[i];
+  if(n != sstat[SYS_getpid].count){
+    printf("sysstat: bad histogram for this process\n");
+    exit(1);
+  }
+  sysstat(0, sstat, SYS_getpid+1);
+  if(sstat[SYS_getpid].count < before + 20){
+    printf("sysstat: bad system-wide counts\n");
+    exit(1);
+  }
+  if(sysstat(1000000, sstat, SYS_getpid+1) != -1){
+    printf("sysstat: counts for a missing process\n");
+    exit(1);
+  }
+  printf("sysstat ok\n");
+}
+
+// sleepers wake on time even though idle CPUs stop their
+// timers: each child sleeps a different number of ticks while
+// nothing else runs, and must not oversleep by much.
+void
+sleeptest(void)
+{
+  int i, pid, xstatus;
+  uint t0;
+
+  printf("sleep test\n");
+  for(i = 1; i <= 4; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("sleep: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      t0 = uptime();
+      sleep(3*i);
+      t0 = uptime() - t0;
+      exit(t0 < 3*i || t0 > 3*i + 2);
+    }
+  }
+  for(i = 1; i <= 4; i++){
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("sleep: slept the wrong time\n");
+      exit(1);
+    }
+  }
+  printf("sleep ok\n");
+}
+
+// does s[0..n) contain t?
+int
+contains(char *s, int n, char *t)
+{
+  int i, j;
+
+  for(i = 0; i < n; i++){
+    for(j = 0; t[j] && i + j < n && s[i+j] == t[j]; j++)
+      ;
+    if(t[j] == 0)
+      return 1;
+  }
+  return 0;
+}
+
+// dmesg() returns the end of the kernel's messages, which
+// includes the one about a child's bad memory reference.
+void
+dmesgtest(void)
+{
+  char tail[8];
+  int pid, n, i;
+
+  printf("dmesg test\n");
+  pid = fork();
+  if(pid < 0){
+    printf("dmesg: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    *(volatile char*)0xffffffffffL = 1;
+    exit(0);
+  }
+  wait(0);
+
+  n = dmesg(buf, 200);
+  if(n <= 0 || n > 200 || !contains(buf, n, "usertrap")){
+    printf("dmesg: no message about the child\n");
+    exit(1);
+  }
+  if(dmesg(tail, sizeof(tail)) != sizeof(tail)){
+    printf("dmesg: short read\n");
+    exit(1);
+  }
+  for(i = 0; i < sizeof(tail); i++){
+    if(tail[i] != buf[n - sizeof(tail) + i]){
+      printf("dmesg: log doesn't end the same way\n");
+      exit(1);
+    }
+  }
+  if(dmesg((char*)0xffffffffffL, 10) != -1){
+    printf("dmesg: copied to a bad address\n");
+    exit(1);
+  }
+  printf("dmesg ok\n");
+}
+
 // can I unlink a file and still read it?
 void
 unlinkread(void)
@@ -1511,6 +2230,67 @@ dirfile(void)
   printf("dir vs file OK\n");
 }
 
+// hold more distinct inodes open at once than the
+// inode cache starts out with.
+void
+manyinodes(void)
+{
+  enum { NCHILD = 8, NPER = 8 };
+  int i, j, fd, pid, xstatus, go[2], ready[2];
+  char name[8], c;
+
+  printf("manyinodes test\n");
+  if(pipe(go) < 0 || pipe(ready) < 0){
+    printf("pipe failed\n");
+    exit(1);
+  }
+  for(i = 0; i < NCHILD; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      close(go[1]);
+      name[0] = 'm';
+      name[1] = 'i';
+      name[2] = '0' + i;
+      name[4] = '\0';
+      for(j = 0; j < NPER; j++){
+        name[3] = 'a' + j;
+        if(open(name, O_CREATE|O_RDWR) < 0){
+          printf("manyinodes: create %s failed\n", name);
+          exit(1);
+        }
+      }
+      write(ready[1], "x", 1);
+      read(go[0], &c, 1);  // wait for parent to close go[1]
+      for(j = 0; j < NPER; j++){
+        name[3] = 'a' + j;
+        unlink(name);
+      }
+      exit(0);
+    }
+  }
+  close(go[0]);
+  for(i = 0; i < NCHILD; i++)
+    read(ready[0], &c, 1);
+  if((fd = open(".", O_RDONLY)) < 0){
+    printf("manyinodes: open . failed\n");
+    exit(1);
+  }
+  close(fd);
+  close(go[1]);
+  for(i = 0; i < NCHILD; i++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(xstatus);
+  }
+  close(ready[0]);
+  close(ready[1]);
+  printf("manyinodes ok\n");
+}
+
 // test that iput() is called at the end of _namei()
 void
 iref(void)
@@ -1991,6 +2771,7 @@ main(int argc, char *argv[])
 
   mem();
   pipe1();
+  pipe2();
   preempt();
   exitwait();
 
@@ -2000,8 +2781,20 @@ main(int argc, char *argv[])
   subdir();
   linktest();
   unlinkread();
+  namecache();
+  posio();
+  sendsplice();
+  iovbatch();
+  stdiotest();
+  proftest();
+  sysstattest();
+  dmesgtest();
+  sleeptest();
+  tracetest();
+  spreadtest();
   dirfile();
   iref();
+  manyinodes();
   forktest();
   bigdir(); // slow
 
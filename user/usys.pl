@@ -8,15 +8,16 @@ print "#include \"kernel/syscall.h\"\n";
 
 sub entry {
     my $name = shift;
-    print ".global $name\n";
-    print "${name}:\n";
+    my $stub = shift || $name;
+    print ".global $stub\n";
+    print "${stub}:\n";
     print " li a7, SYS_${name}\n";
     print " ecall\n";
     print " ret\n";
 }
 	
 entry("fork");
-entry("exit");
+entry("exit", "_exit");  # exit() in ulib.c flushes stdio first
 entry("wait");
 entry("pipe");
 entry("read");
@@ -40,3 +41,20 @@ entry("ntas");
 entry("crash");
 entry("mount");
 entry("umount");
+entry("shmat");
+entry("shmdt");
+entry("futex_wait");
+entry("futex_wake");
+entry("clone");
+entry("join");
+entry("pread");
+entry("pwrite");
+entry("fsync");
+entry("ftruncate");
+entry("sendfile");
+entry("splice");
+entry("readv");
+entry("writev");
+entry("sysbatch");
+entry("sysstat");
+entry("dmesg");